@@ -1,226 +1,398 @@
 #ifndef _DB_SRV_ACCESSOR_H
 #define _DB_SRV_ACCESSOR_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
 #include <vector>
+#include "flight.h"
 #include "replace.h"
+#include "statement.h"
 #include "traits.h"
 
 struct Accessor
 {
     virtual ~Accessor() = default;
-    virtual bool Render(const std::string& sql, std::string& res) = 0;
+    virtual bool Render(const SqlTemplate& sql, std::string& res) = 0;
+    // 预处理语句: 每个 ? 按 slot_vect 的顺序绑定参数
+    virtual bool CanBind(const SqlTemplate&) { return false; }
+    virtual bool Bind(const SqlTemplate&, const std::vector<size_t>&, std::vector<MYSQL_BIND>&) { return false; }
     virtual std::vector<std::shared_ptr<Accessor>> MakeSubAccessor(size_t group) = 0;
-};
+    // 字符串参数是否经过 m_escape 渲染; 自定义渲染的访问器不能转义
+    virtual bool CanEscape() const { return false; }
 
-template <typename Source, typename T = typename std::decay<Source>::type, typename PARAM = typename GetValueType<T>::type>
-struct BindAccessor : Accessor
-{
-    using iter = typename T::const_iterator;
-    using bind_vect_t = std::vector<std::function<void(std::string&, const PARAM&)>>;
+    // 设置了 m_filter 时跳过已经渲染过的 sql
+    bool RenderUnique(const SqlTemplate& sql, std::string& res)
+    {
+        while (Render(sql, res))
+        {
+            if (!m_filter || m_filter->Insert(res))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-    template <typename... ARGS>
-    explicit BindAccessor(std::shared_ptr<Source> data, ARGS&&... args)
-        : m_param(data)
+    // 批量渲染: 最多 count 个元素按 row 模板渲染后用 , 连接, 总长度不超过 max_bytes, 填入 sql 模板的 {batch}
+    bool RenderBatch(const SqlTemplate& sql, const SqlTemplate& row, size_t count, size_t max_bytes, std::string& res)
     {
-        m_param = data;
-        Init(data->begin(), data->end());
-        SetBind(args...);
+        size_t n = 0;
+        m_batch.clear();
+        if (m_has_pending)
+        {
+            m_batch.swap(m_pending);
+            m_has_pending = false;
+            n++;
+        }
+
+        while (n < count && RenderUnique(row, m_item))
+        {
+            if (n > 0 && m_batch.size() + 1 + m_item.size() > max_bytes)
+            {
+                // 超出包大小, 留到下一批
+                m_pending.swap(m_item);
+                m_has_pending = true;
+                break;
+            }
+
+            if (n > 0)
+            {
+                m_batch.push_back(',');
+            }
+            m_batch.append(m_item);
+            n++;
+        }
+
+        if (n == 0)
+        {
+            return false;
+        }
+
+        int32_t batch_slot = sql.FindSlot("batch");
+        sql.Render(res, [&](std::string& out, size_t slot) {
+            if (static_cast<int32_t>(slot) != batch_slot)
+            {
+                return false;
+            }
+            out.append(m_batch);
+            return true;
+        });
+        return true;
     }
 
-    BindAccessor(iter& begin, iter& end, const bind_vect_t& vect)
-        : m_begin(begin)
-        , m_end(end)
-        , m_bind_vect(vect)
-    {}
+    std::shared_ptr<SqlFilter> m_filter;
+    // 设置时字符串参数转义后再拼入 sql
+    std::function<void(std::string&, const char*, size_t)> m_escape;
+    std::string m_batch;
+    std::string m_item;
+    std::string m_pending;
+    bool m_has_pending = false;
+};
 
-    template <typename P, typename... ARGS>
-    void SetBind(const std::string& field, P(PARAM::*ptr), ARGS&&... args)
+// 参数游标: 参数只展开一次, 子访问器通过原子下标每次领取一段, 段的大小按上一段的耗时调整
+template <typename PARAM>
+struct ParamCursor
+{
+    ParamCursor(std::vector<const PARAM*> param_vect, size_t group)
+        : m_param_vect(std::move(param_vect))
+        , m_group(std::max<size_t>(group, 1))
     {
-        SetBind(field, ptr);
-        SetBind(args...);
     }
 
-    template <typename P>
-    void SetBind(const std::string& field, P(PARAM::*ptr))
+    // 领取 [begin, end), 参数已经分完时返回 false
+    bool Grab(size_t count, size_t& begin, size_t& end)
     {
-        m_bind_vect.template emplace_back([field, ptr](std::string& sql, const PARAM& param) { Replace::SetData(sql, field, param.*ptr); });
+        begin = m_next.fetch_add(count);
+        if (begin >= m_param_vect.size())
+        {
+            return false;
+        }
+        end = std::min(begin + count, m_param_vect.size());
+        return true;
     }
 
-    bool Render(const std::string& sql, std::string& res) override
+    // 按单个参数的耗时估算段大小, 每段约 m_chunk_us; 剩余参数越少段越小, 避免最后一段拖慢整体
+    size_t ChunkSize(size_t last_count, int64_t last_us) const
     {
-        if (!IsValid())
+        size_t next = m_next.load(std::memory_order_relaxed);
+        size_t left = next < m_param_vect.size() ? m_param_vect.size() - next : 0;
+        if (m_group == 1)
         {
-            return false;
+            return std::max<size_t>(left, 1);
         }
-        res = sql;
-        for (auto& bind : m_bind_vect)
+
+        size_t guided = std::max<size_t>(left / (m_group * 2), 1);
+        if (last_count == 0)
         {
-            bind(res, Value());
+            return 1;
         }
-        Next();
-        return true;
+
+        size_t want = last_us > 0 ? static_cast<size_t>(m_chunk_us * static_cast<int64_t>(last_count) / last_us) : guided;
+        return std::min(std::max<size_t>(want, 1), guided);
     }
 
-    bool IsValid() { return m_begin != m_end; }
+    static constexpr int64_t m_chunk_us = 20000;
+    std::vector<const PARAM*> m_param_vect;
+    size_t m_group;
+    std::atomic<size_t> m_next{0};
+};
+
+// 遍历参数容器的访问器基类, 拆分出的子访问器共享一个 ParamCursor
+template <typename Source, typename T = typename std::decay<Source>::type, typename PARAM = typename GetValueType<T>::type>
+struct RangeAccessor : Accessor
+{
+    using iter = typename T::const_iterator;
+    using cursor_t = ParamCursor<PARAM>;
 
-    void Init(iter begin, iter end)
+    explicit RangeAccessor(std::shared_ptr<Source> data)
+        : m_param(data)
     {
-        m_begin = begin;
-        m_end = end;
     }
 
-    bool Next()
+    // 当前段用完时从游标领取下一段, 参数已经分完时返回 false
+    bool Acquire() { return m_pos < m_end || Grab(); }
+
+    const PARAM& Value() { return *m_cursor->m_param_vect[m_pos]; }
+
+    void Next() { m_pos++; }
+
+    // 每次运行都从头遍历参数容器
+    template <typename SUB>
+    std::vector<std::shared_ptr<Accessor>> Split(const SUB& self, size_t group)
     {
-        if (m_begin == m_end)
+        auto cursor = MakeCursor(group);
+        size_t count = cursor->m_group;
+        std::vector<std::shared_ptr<Accessor>> res;
+        for (size_t i = 0; i < count; i++)
         {
-            return false;
+            auto sub = std::make_shared<SUB>(self);
+            sub->Attach(cursor);
+            res.emplace_back(sub);
         }
-
-        m_begin++;
-        return m_begin != m_end;
+        return res;
     }
 
-    const PARAM& Value() { return GetValueType<T>::Getter(m_begin); }
+    void Attach(std::shared_ptr<cursor_t> cursor)
+    {
+        m_cursor = std::move(cursor);
+        m_pos = m_end = m_begin = 0;
+    }
 
-    std::vector<std::shared_ptr<Accessor>> MakeSubAccessor(size_t group) override
+private:
+    // 子访问器个数不超过参数个数
+    std::shared_ptr<cursor_t> MakeCursor(size_t group)
     {
-        if (!IsValid())
+        std::vector<const PARAM*> param_vect;
+        for (iter it = m_param->begin(); it != m_param->end(); ++it)
         {
-            return {std::make_shared<BindAccessor>(m_begin, m_end, m_bind_vect)};
+            param_vect.emplace_back(&GetValueType<T>::Getter(it));
         }
+        group = std::min(group, std::max<size_t>(param_vect.size(), 1));
+        return std::make_shared<cursor_t>(std::move(param_vect), group);
+    }
 
-        size_t count = std::distance(m_begin, m_end);
-        std::vector<std::shared_ptr<Accessor>> res;
-        size_t size = count / group;
-        auto begin = m_begin;
-        auto end = m_end;
-
-        if (size == 0)
+    bool Grab()
+    {
+        if (!m_cursor)
         {
-            for (size_t i = 0; i < count; i++)
-            {
-                auto last_begin = begin;
-                std::advance(begin, 1);
-                res.template emplace_back(std::make_shared<BindAccessor>(last_begin, begin, m_bind_vect));
-            }
+            Attach(MakeCursor(1));
         }
-        else
+
+        auto now = std::chrono::steady_clock::now();
+        int64_t last_us = std::chrono::duration_cast<std::chrono::microseconds>(now - m_grab_time).count();
+        size_t count = m_cursor->ChunkSize(m_end - m_begin, last_us);
+        m_grab_time = now;
+        if (!m_cursor->Grab(count, m_begin, m_end))
         {
-            for (size_t i = 0; i < group; i++)
-            {
-                auto last_begin = begin;
-                std::advance(begin, size);
-                res.template emplace_back(std::make_shared<BindAccessor>(last_begin, begin, m_bind_vect));
-            }
-            if (count % group > 0)
-            {
-                res.template emplace_back(std::make_shared<BindAccessor>(begin, end, m_bind_vect));
-            }
+            m_pos = m_end = m_begin = 0;
+            return false;
         }
-        return res;
+        m_pos = m_begin;
+        return true;
     }
+
+protected:
     std::shared_ptr<Source> m_param;
-    std::vector<std::function<void(std::string&, const PARAM&)>> m_bind_vect;
-    iter m_begin;
-    iter m_end;
+
+private:
+    std::shared_ptr<cursor_t> m_cursor;
+    size_t m_begin = 0;
+    size_t m_pos = 0;
+    size_t m_end = 0;
+    std::chrono::steady_clock::time_point m_grab_time;
 };
 
 template <typename Source, typename T = typename std::decay<Source>::type, typename PARAM = typename GetValueType<T>::type>
-struct CustomAccessor : Accessor
+struct BindAccessor : RangeAccessor<Source>
 {
-    using iter = typename T::const_iterator;
-    using render_t = std::function<void(std::string&, const PARAM&)>;
+    using RangeAccessor<Source>::Acquire;
+    using RangeAccessor<Source>::Value;
+    using RangeAccessor<Source>::Next;
 
-    explicit CustomAccessor(std::shared_ptr<Source> data, render_t render)
-        : m_param(data)
-        , m_render(render)
+    using escape_t = std::function<void(std::string&, const char*, size_t)>;
+
+    struct ParamBind
+    {
+        std::string m_field;
+        std::function<void(std::string&, const PARAM&, const escape_t&)> m_append;
+        std::function<void(MYSQL_BIND&, const PARAM&)> m_param;
+    };
+    using bind_vect_t = std::vector<ParamBind>;
+
+    template <typename... ARGS>
+    explicit BindAccessor(std::shared_ptr<Source> data, ARGS&&... args)
+        : RangeAccessor<Source>(data)
     {
-        Init(data->begin(), data->end());
+        SetBind(args...);
     }
 
-    CustomAccessor(iter& begin, iter& end, render_t render)
-        : m_begin(begin)
-        , m_end(end)
-        , m_render(render)
-    {}
+    template <typename P, typename... ARGS>
+    void SetBind(const std::string& field, P(PARAM::*ptr), ARGS&&... args)
+    {
+        SetBind(field, ptr);
+        SetBind(args...);
+    }
 
-    bool Render(const std::string& sql, std::string& res) override
+    template <typename P>
+    void SetBind(const std::string& field, P(PARAM::*ptr))
+    {
+        m_bind_vect.emplace_back(ParamBind{field,
+                                           [ptr](std::string& sql, const PARAM& param, const escape_t& escape) { Append(sql, param.*ptr, escape); },
+                                           [ptr](MYSQL_BIND& bind, const PARAM& param) { StmtBind::Param(bind, param.*ptr); }});
+    }
+
+    // 只有字符串需要转义
+    static void Append(std::string& sql, const std::string& data, const escape_t& escape)
     {
-        if (!IsValid() || !m_render)
+        if (escape)
         {
-            return false;
+            escape(sql, data.data(), data.size());
+            return;
         }
-        res = sql;
-        m_render(res, Value());
-        Next();
-        return true;
+        sql.append(data);
     }
 
-    bool IsValid() { return m_begin != m_end; }
+    static void Append(std::string& sql, const char* data, const escape_t& escape) { Append(sql, std::string(data), escape); }
 
-    void Init(iter begin, iter end)
+    template <typename DATA>
+    static void Append(std::string& sql, const DATA& data, const escape_t&)
     {
-        m_begin = begin;
-        m_end = end;
+        Replace::Append(sql, data);
     }
 
-    bool Next()
+    bool Render(const SqlTemplate& sql, std::string& res) override
     {
-        if (m_begin == m_end)
+        if (!Acquire())
         {
             return false;
         }
 
-        m_begin++;
-        return m_begin != m_end;
+        Resolve(sql);
+        const PARAM& param = Value();
+        sql.Render(res, [&](std::string& out, size_t slot) {
+            if (m_slot_bind[slot] < 0)
+            {
+                return false;
+            }
+            m_bind_vect[m_slot_bind[slot]].m_append(out, param, this->m_escape);
+            return true;
+        });
+        Next();
+        return true;
     }
 
-    const PARAM& Value() { return GetValueType<T>::Getter(m_begin); }
+    bool CanBind(const SqlTemplate& sql) override
+    {
+        Resolve(sql);
+        for (auto bind : m_slot_bind)
+        {
+            if (bind < 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    std::vector<std::shared_ptr<Accessor>> MakeSubAccessor(size_t group) override
+    bool Bind(const SqlTemplate& sql, const std::vector<size_t>& slot_vect, std::vector<MYSQL_BIND>& param_vect) override
     {
-        if (!IsValid())
+        if (!Acquire())
         {
-            return {std::make_shared<CustomAccessor>(m_begin, m_end, m_render)};
+            return false;
         }
 
-        size_t count = std::distance(m_begin, m_end);
-        std::vector<std::shared_ptr<Accessor>> res;
-        size_t size = count / group;
-        auto begin = m_begin;
-        auto end = m_end;
+        Resolve(sql);
+        const PARAM& param = Value();
+        param_vect.assign(slot_vect.size(), MYSQL_BIND());
+        for (size_t i = 0; i < slot_vect.size(); i++)
+        {
+            m_bind_vect[m_slot_bind[slot_vect[i]]].m_param(param_vect[i], param);
+        }
+        Next();
+        return true;
+    }
 
-        if (size == 0)
+    // 模板变化时重新建立 参数下标 -> 绑定 的映射
+    void Resolve(const SqlTemplate& sql)
+    {
+        if (m_template_id == sql.Id())
         {
-            for (size_t i = 0; i < count; i++)
-            {
-                auto last_begin = begin;
-                std::advance(begin, 1);
-                res.template emplace_back(std::make_shared<CustomAccessor>(last_begin, begin, m_render));
-            }
+            return;
         }
-        else
+
+        m_template_id = sql.Id();
+        m_slot_bind.assign(sql.SlotCount(), -1);
+        for (size_t i = 0; i < m_bind_vect.size(); i++)
         {
-            for (size_t i = 0; i < group; i++)
+            int32_t slot = sql.FindSlot(m_bind_vect[i].m_field);
+            if (slot >= 0 && m_slot_bind[slot] < 0)
             {
-                auto last_begin = begin;
-                std::advance(begin, size);
-                res.template emplace_back(std::make_shared<CustomAccessor>(last_begin, begin, m_render));
-            }
-            if (count % group > 0)
-            {
-                res.template emplace_back(std::make_shared<CustomAccessor>(begin, end, m_render));
+                m_slot_bind[slot] = static_cast<int32_t>(i);
             }
         }
-        return res;
     }
 
-    std::shared_ptr<Source> m_param;
-    iter m_begin;
-    iter m_end;
+    std::vector<std::shared_ptr<Accessor>> MakeSubAccessor(size_t group) override { return this->Split(*this, group); }
+
+    bool CanEscape() const override { return true; }
+
+    bind_vect_t m_bind_vect;
+    uint64_t m_template_id = 0;
+    std::vector<int32_t> m_slot_bind;
+};
+
+template <typename Source, typename T = typename std::decay<Source>::type, typename PARAM = typename GetValueType<T>::type>
+struct CustomAccessor : RangeAccessor<Source>
+{
+    using RangeAccessor<Source>::Acquire;
+    using RangeAccessor<Source>::Value;
+    using RangeAccessor<Source>::Next;
+    using render_t = std::function<void(std::string&, const PARAM&)>;
+
+    explicit CustomAccessor(std::shared_ptr<Source> data, render_t render)
+        : RangeAccessor<Source>(data)
+        , m_render(render)
+    {
+    }
+
+    bool Render(const SqlTemplate& sql, std::string& res) override
+    {
+        if (!Acquire() || !m_render)
+        {
+            return false;
+        }
+        res = sql.Source();
+        m_render(res, Value());
+        Next();
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Accessor>> MakeSubAccessor(size_t group) override { return this->Split(*this, group); }
+
     render_t m_render;
 };
 
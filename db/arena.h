@@ -0,0 +1,113 @@
+#ifndef _DB_ARENA_H
+#define _DB_ARENA_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// 只增不减的内存块, 随结果集一起释放; 设置了 resource 时内存块从 resource 分配, 由 resource 统一释放
+class Arena
+{
+public:
+    explicit Arena(size_t block_size = 64 * 1024)
+        : m_block_size(block_size)
+    {
+    }
+
+    explicit Arena(std::shared_ptr<std::pmr::memory_resource> resource, size_t block_size = 64 * 1024)
+        : m_block_size(block_size)
+        , m_resource(std::move(resource))
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    std::string_view Copy(const char* ptr, size_t len)
+    {
+        if (len == 0)
+        {
+            return {};
+        }
+
+        if (len > m_left)
+        {
+            Grow(len);
+        }
+
+        char* dst = m_cur;
+        memcpy(dst, ptr, len);
+        m_cur += len;
+        m_left -= len;
+        m_size += len;
+        return {dst, len};
+    }
+
+    size_t Size() const { return m_size; }
+
+    // 引用 other 的内存块, other 释放后从它复制来的字符串仍然有效
+    void Share(const Arena& other)
+    {
+        m_block_vect.insert(m_block_vect.end(), other.m_block_vect.begin(), other.m_block_vect.end());
+    }
+
+private:
+    void Grow(size_t len)
+    {
+        size_t size = std::max(m_block_size, len);
+        if (m_resource)
+        {
+            // 内存块引用 resource, 共享给其他 arena 后 resource 仍然有效
+            m_block_vect.emplace_back(static_cast<char*>(m_resource->allocate(size, 1)), [resource = m_resource](char*) {});
+        }
+        else
+        {
+            m_block_vect.emplace_back(new char[size], std::default_delete<char[]>());
+        }
+        m_cur = m_block_vect.back().get();
+        m_left = size;
+        m_block_size = std::min(m_block_size * 2, m_max_block_size);
+    }
+
+    static constexpr size_t m_max_block_size = 4 * 1024 * 1024;
+    size_t m_block_size;
+    size_t m_left = 0;
+    size_t m_size = 0;
+    char* m_cur = nullptr;
+    std::shared_ptr<std::pmr::memory_resource> m_resource;
+    std::vector<std::shared_ptr<char>> m_block_vect;
+};
+
+// 加锁的内存资源, 并行查询的分片在不同线程上填充时共享同一个上游资源
+class LockedResource : public std::pmr::memory_resource
+{
+public:
+    explicit LockedResource(std::shared_ptr<std::pmr::memory_resource> upstream)
+        : m_upstream(std::move(upstream))
+    {
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        return m_upstream->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t align) override
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_upstream->deallocate(ptr, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::mutex m_mut;
+    std::shared_ptr<std::pmr::memory_resource> m_upstream;
+};
+
+#endif  // _DB_ARENA_H
@@ -0,0 +1,234 @@
+#ifndef _DB_CACHE_H
+#define _DB_CACHE_H
+
+#include <mysql/mysql.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 缓存的结果集, 生成后只读, 多个线程可以同时读取
+struct CacheResult
+{
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    explicit CacheResult(std::vector<std::string> field_vect)
+        : m_column(field_vect.size())
+        , m_field_vect(std::move(field_vect))
+    {
+    }
+
+    void AddRow(MYSQL_ROW row, const unsigned long* length)
+    {
+        for (size_t i = 0; i < m_column; i++)
+        {
+            if (!row[i])
+            {
+                m_offset_vect.push_back(npos);
+                m_length_vect.push_back(0);
+                continue;
+            }
+            m_offset_vect.push_back(m_data.size());
+            m_length_vect.push_back(length[i]);
+            m_data.append(row[i], length[i]);
+            // 保持和 mysql 一样以 \0 结尾
+            m_data.push_back('\0');
+        }
+    }
+
+    // 数据全部写入后再生成指针, 之后 m_data 不再变化
+    void Finish()
+    {
+        m_data.shrink_to_fit();
+        m_cell_vect.resize(m_offset_vect.size());
+        for (size_t i = 0; i < m_offset_vect.size(); i++)
+        {
+            m_cell_vect[i] = m_offset_vect[i] == npos ? nullptr : &m_data[m_offset_vect[i]];
+        }
+    }
+
+    size_t RowCount() const { return m_column ? m_cell_vect.size() / m_column : 0; }
+
+    MYSQL_ROW Row(size_t i) const { return const_cast<char**>(&m_cell_vect[i * m_column]); }
+
+    unsigned long* Length(size_t i) const { return const_cast<unsigned long*>(&m_length_vect[i * m_column]); }
+
+    size_t Bytes() const
+    {
+        size_t bytes = sizeof(CacheResult) + m_data.capacity();
+        bytes += m_offset_vect.capacity() * sizeof(size_t) + m_length_vect.capacity() * sizeof(unsigned long) + m_cell_vect.capacity() * sizeof(char*);
+        for (auto& field : m_field_vect)
+        {
+            bytes += field.capacity();
+        }
+        return bytes;
+    }
+
+    size_t m_column = 0;
+    std::vector<std::string> m_field_vect;
+    std::string m_data;
+    std::vector<size_t> m_offset_vect;
+    std::vector<unsigned long> m_length_vect;
+    std::vector<char*> m_cell_vect;
+};
+
+// 进程内结果缓存, key 为 配置名 + sql, 分片加锁, 每个分片按 LRU 淘汰到容量以内
+class ResultCache
+{
+public:
+    struct Stat
+    {
+        uint64_t m_hit = 0;
+        uint64_t m_miss = 0;
+        uint64_t m_evict = 0;
+        size_t m_count = 0;
+        size_t m_bytes = 0;
+    };
+
+    static ResultCache& Instance()
+    {
+        static ResultCache cache;
+        return cache;
+    }
+
+    explicit ResultCache(size_t capacity = 64 * 1024 * 1024)
+    {
+        SetCapacity(capacity);
+    }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    void SetCapacity(size_t capacity) { m_shard_capacity = capacity / m_shard_num; }
+
+    std::shared_ptr<const CacheResult> Get(const std::string& conf_name, const std::string& sql)
+    {
+        std::string key = Key(conf_name, sql);
+        Shard& shard = m_shard_vect[std::hash<std::string>()(key) % m_shard_num];
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lk(shard.m_mut);
+        auto iter = shard.m_index_table.find(key);
+        if (iter == shard.m_index_table.end())
+        {
+            m_miss++;
+            return nullptr;
+        }
+
+        if (iter->second->m_expire <= now)
+        {
+            Erase(shard, iter->second);
+            m_miss++;
+            return nullptr;
+        }
+
+        // 移到 LRU 链表头部
+        shard.m_lru_list.splice(shard.m_lru_list.begin(), shard.m_lru_list, iter->second);
+        m_hit++;
+        return iter->second->m_result;
+    }
+
+    void Put(const std::string& conf_name, const std::string& sql, std::shared_ptr<const CacheResult> result, int64_t ttl_ms)
+    {
+        std::string key = Key(conf_name, sql);
+        size_t bytes = result->Bytes() + key.capacity();
+        size_t capacity = m_shard_capacity;
+        if (bytes > capacity)
+        {
+            return;
+        }
+
+        Shard& shard = m_shard_vect[std::hash<std::string>()(key) % m_shard_num];
+        auto expire = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttl_ms);
+        std::lock_guard<std::mutex> lk(shard.m_mut);
+        auto iter = shard.m_index_table.find(key);
+        if (iter != shard.m_index_table.end())
+        {
+            Erase(shard, iter->second);
+        }
+
+        while (shard.m_bytes + bytes > capacity && !shard.m_lru_list.empty())
+        {
+            Erase(shard, std::prev(shard.m_lru_list.end()));
+            m_evict++;
+        }
+
+        shard.m_lru_list.push_front(Entry{key, std::move(result), expire, bytes});
+        shard.m_index_table.emplace(std::move(key), shard.m_lru_list.begin());
+        shard.m_bytes += bytes;
+    }
+
+    void Clear()
+    {
+        for (auto& shard : m_shard_vect)
+        {
+            std::lock_guard<std::mutex> lk(shard.m_mut);
+            shard.m_index_table.clear();
+            shard.m_lru_list.clear();
+            shard.m_bytes = 0;
+        }
+    }
+
+    Stat GetStat()
+    {
+        Stat stat;
+        stat.m_hit = m_hit;
+        stat.m_miss = m_miss;
+        stat.m_evict = m_evict;
+        for (auto& shard : m_shard_vect)
+        {
+            std::lock_guard<std::mutex> lk(shard.m_mut);
+            stat.m_count += shard.m_lru_list.size();
+            stat.m_bytes += shard.m_bytes;
+        }
+        return stat;
+    }
+
+private:
+    struct Entry
+    {
+        std::string m_key;
+        std::shared_ptr<const CacheResult> m_result;
+        std::chrono::steady_clock::time_point m_expire;
+        size_t m_bytes;
+    };
+
+    struct Shard
+    {
+        std::mutex m_mut;
+        std::list<Entry> m_lru_list;
+        std::unordered_map<std::string, std::list<Entry>::iterator> m_index_table;
+        size_t m_bytes = 0;
+    };
+
+    static std::string Key(const std::string& conf_name, const std::string& sql)
+    {
+        std::string key;
+        key.reserve(conf_name.size() + 1 + sql.size());
+        key.append(conf_name);
+        key.push_back('\0');
+        key.append(sql);
+        return key;
+    }
+
+    static void Erase(Shard& shard, std::list<Entry>::iterator iter)
+    {
+        shard.m_bytes -= iter->m_bytes;
+        shard.m_index_table.erase(iter->m_key);
+        shard.m_lru_list.erase(iter);
+    }
+
+    static constexpr size_t m_shard_num = 16;
+    Shard m_shard_vect[m_shard_num];
+    std::atomic<size_t> m_shard_capacity{0};
+    std::atomic<uint64_t> m_hit{0};
+    std::atomic<uint64_t> m_miss{0};
+    std::atomic<uint64_t> m_evict{0};
+};
+
+#endif  // _DB_CACHE_H
@@ -0,0 +1,360 @@
+#ifndef _DB_COLUMN_H
+#define _DB_COLUMN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "traits.h"
+
+// 行号列表, Filter 的结果, 可以继续传给其他算子
+using Selection = std::vector<uint32_t>;
+
+// bool 列按 uint8_t 保存, 保证是连续数组
+template <typename DATA>
+using column_value_t = std::conditional_t<std::is_same<DATA, bool>::value, uint8_t, DATA>;
+
+// 列的计算: 只使用连续数组和互不依赖的累加器, 交给编译器向量化
+struct ColumnKernel
+{
+    static constexpr size_t m_lane = 8;
+
+    // 整数累加到 64 位, 浮点数累加到 double
+    template <typename DATA>
+    using sum_t = std::conditional_t<std::is_floating_point<DATA>::value, double, std::conditional_t<std::is_signed<DATA>::value, int64_t, uint64_t>>;
+
+    template <typename DATA>
+    static sum_t<DATA> Sum(const DATA* data, size_t size)
+    {
+        sum_t<DATA> acc[m_lane] = {};
+        size_t i = 0;
+        for (; i + m_lane <= size; i += m_lane)
+        {
+            for (size_t k = 0; k < m_lane; k++)
+            {
+                acc[k] += data[i + k];
+            }
+        }
+
+        sum_t<DATA> sum = 0;
+        for (; i < size; i++)
+        {
+            sum += data[i];
+        }
+        for (size_t k = 0; k < m_lane; k++)
+        {
+            sum += acc[k];
+        }
+        return sum;
+    }
+
+    template <typename DATA>
+    static sum_t<DATA> Sum(const DATA* data, const Selection& sel)
+    {
+        sum_t<DATA> sum = 0;
+        for (uint32_t i : sel)
+        {
+            sum += data[i];
+        }
+        return sum;
+    }
+
+    // size 为 0 时返回 DATA()
+    template <typename DATA, typename COMP>
+    static DATA Extreme(const DATA* data, size_t size, COMP comp)
+    {
+        if (size == 0)
+        {
+            return DATA();
+        }
+
+        DATA acc[m_lane];
+        std::fill(acc, acc + m_lane, data[0]);
+        size_t i = 0;
+        for (; i + m_lane <= size; i += m_lane)
+        {
+            for (size_t k = 0; k < m_lane; k++)
+            {
+                acc[k] = comp(data[i + k], acc[k]) ? data[i + k] : acc[k];
+            }
+        }
+
+        DATA res = data[0];
+        for (; i < size; i++)
+        {
+            res = comp(data[i], res) ? data[i] : res;
+        }
+        for (size_t k = 0; k < m_lane; k++)
+        {
+            res = comp(acc[k], res) ? acc[k] : res;
+        }
+        return res;
+    }
+
+    template <typename DATA, typename COMP>
+    static DATA Extreme(const DATA* data, const Selection& sel, COMP comp)
+    {
+        if (sel.empty())
+        {
+            return DATA();
+        }
+
+        DATA res = data[sel[0]];
+        for (uint32_t i : sel)
+        {
+            res = comp(data[i], res) ? data[i] : res;
+        }
+        return res;
+    }
+
+    // 不分支: 每行都写入行号, 满足条件时才前进
+    template <typename DATA, typename PRED>
+    static void Filter(const DATA* data, size_t size, PRED pred, Selection& out)
+    {
+        out.resize(size);
+        size_t n = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            out[n] = static_cast<uint32_t>(i);
+            n += pred(data[i]) ? 1 : 0;
+        }
+        out.resize(n);
+    }
+
+    template <typename DATA, typename PRED>
+    static void Filter(const DATA* data, const Selection& sel, PRED pred, Selection& out)
+    {
+        out.resize(sel.size());
+        size_t n = 0;
+        for (uint32_t i : sel)
+        {
+            out[n] = i;
+            n += pred(data[i]) ? 1 : 0;
+        }
+        out.resize(n);
+    }
+};
+
+// 分组聚合的结果
+template <typename DATA>
+struct Aggregate
+{
+    size_t m_count = 0;
+    ColumnKernel::sum_t<DATA> m_sum = 0;
+    DATA m_min = DATA();
+    DATA m_max = DATA();
+
+    void Add(const DATA& value)
+    {
+        if (m_count++ == 0)
+        {
+            m_min = value;
+            m_max = value;
+        }
+        else
+        {
+            m_min = value < m_min ? value : m_min;
+            m_max = m_max < value ? value : m_max;
+        }
+        AddSum(value, std::is_arithmetic<DATA>());
+    }
+
+    void AddSum(const DATA& value, std::true_type) { m_sum += value; }
+
+    void AddSum(const DATA&, std::false_type) {}
+};
+
+struct ColumnBase
+{
+    virtual ~ColumnBase() = default;
+    // 并行查询的分片合并, 追加到末尾
+    virtual void Append(ColumnBase& src) = 0;
+};
+
+template <typename OBJ, typename DATA>
+struct Column : ColumnBase
+{
+    explicit Column(DATA(OBJ::*ptr))
+        : m_ptr(ptr)
+    {
+    }
+
+    void Append(ColumnBase& src) override
+    {
+        auto& src_data = static_cast<Column&>(src).m_data;
+        m_data.insert(m_data.end(), std::make_move_iterator(src_data.begin()), std::make_move_iterator(src_data.end()));
+        src_data.clear();
+    }
+
+    DATA(OBJ::*m_ptr);
+    std::vector<column_value_t<DATA>> m_data;
+};
+
+// 把 OBJ 的成员追加到对应的列, 列不存在时创建; Init 中每个绑定的成员一个
+using column_append_t = std::function<void(std::unique_ptr<ColumnBase>&, const void*)>;
+
+template <typename OBJ, typename DATA>
+column_append_t MakeColumnAppend(DATA(OBJ::*ptr))
+{
+    return [ptr](std::unique_ptr<ColumnBase>& column, const void* obj) {
+        if (!column)
+        {
+            column = std::make_unique<Column<OBJ, DATA>>(ptr);
+        }
+        static_cast<Column<OBJ, DATA>*>(column.get())->m_data.push_back(static_cast<const OBJ*>(obj)->*ptr);
+    };
+}
+
+// 列式存储: Init 中绑定的每个成员保存为一个连续的数组, 使用 Query::StoreColumn<OBJ>() 填充
+template <typename OBJ>
+class ColumnStore
+{
+public:
+    ColumnStore() = default;
+    ColumnStore(ColumnStore&&) = default;
+    ColumnStore& operator=(ColumnStore&&) = default;
+    ColumnStore(const ColumnStore&) = delete;
+    ColumnStore& operator=(const ColumnStore&) = delete;
+
+    size_t Size() const { return m_size; }
+
+    // 没有绑定的成员返回空数组
+    template <typename DATA>
+    const std::vector<column_value_t<DATA>>& Get(DATA(OBJ::*ptr)) const
+    {
+        for (auto& column : m_column_vect)
+        {
+            auto* typed = dynamic_cast<const Column<OBJ, DATA>*>(column.get());
+            if (typed && typed->m_ptr == ptr)
+            {
+                return typed->m_data;
+            }
+        }
+        static const std::vector<column_value_t<DATA>> empty;
+        return empty;
+    }
+
+    // 满足 pred 的行号; sel 不为空时只在 sel 中筛选, 可以串联多个条件
+    template <typename DATA, typename PRED>
+    Selection Filter(DATA(OBJ::*ptr), PRED pred, const Selection* sel = nullptr) const
+    {
+        auto& data = Get(ptr);
+        Selection out;
+        if (sel)
+        {
+            ColumnKernel::Filter(data.data(), *sel, pred, out);
+        }
+        else
+        {
+            ColumnKernel::Filter(data.data(), data.size(), pred, out);
+        }
+        return out;
+    }
+
+    template <typename DATA>
+    ColumnKernel::sum_t<DATA> Sum(DATA(OBJ::*ptr), const Selection* sel = nullptr) const
+    {
+        static_assert(std::is_arithmetic<DATA>::value, "Sum needs an arithmetic column");
+        auto& data = Get(ptr);
+        return sel ? ColumnKernel::Sum(data.data(), *sel) : ColumnKernel::Sum(data.data(), data.size());
+    }
+
+    template <typename DATA>
+    DATA Min(DATA(OBJ::*ptr), const Selection* sel = nullptr) const
+    {
+        auto& data = Get(ptr);
+        auto comp = [](const DATA& a, const DATA& b) { return a < b; };
+        return sel ? ColumnKernel::Extreme(data.data(), *sel, comp) : ColumnKernel::Extreme(data.data(), data.size(), comp);
+    }
+
+    template <typename DATA>
+    DATA Max(DATA(OBJ::*ptr), const Selection* sel = nullptr) const
+    {
+        auto& data = Get(ptr);
+        auto comp = [](const DATA& a, const DATA& b) { return b < a; };
+        return sel ? ColumnKernel::Extreme(data.data(), *sel, comp) : ColumnKernel::Extreme(data.data(), data.size(), comp);
+    }
+
+    // 按 key 列分组, 统计 value 列的 count/sum/min/max
+    template <typename KEY, typename DATA>
+    std::unordered_map<KEY, Aggregate<DATA>> GroupBy(KEY(OBJ::*key), DATA(OBJ::*value), const Selection* sel = nullptr) const
+    {
+        auto& key_data = Get(key);
+        auto& value_data = Get(value);
+        std::unordered_map<KEY, Aggregate<DATA>> res;
+        if (sel)
+        {
+            for (uint32_t i : *sel)
+            {
+                res[key_data[i]].Add(value_data[i]);
+            }
+            return res;
+        }
+
+        for (size_t i = 0; i < key_data.size() && i < value_data.size(); i++)
+        {
+            res[key_data[i]].Add(value_data[i]);
+        }
+        return res;
+    }
+
+    void Append(const std::vector<column_append_t>& append_vect, const OBJ* obj)
+    {
+        if (m_column_vect.size() < append_vect.size())
+        {
+            m_column_vect.resize(append_vect.size());
+        }
+        for (size_t i = 0; i < append_vect.size(); i++)
+        {
+            append_vect[i](m_column_vect[i], obj);
+        }
+        m_size++;
+    }
+
+    void Merge(ColumnStore& src)
+    {
+        if (m_size < src.m_size)
+        {
+            std::swap(m_column_vect, src.m_column_vect);
+            std::swap(m_size, src.m_size);
+        }
+
+        for (size_t i = 0; i < src.m_column_vect.size() && i < m_column_vect.size(); i++)
+        {
+            if (src.m_column_vect[i] && m_column_vect[i])
+            {
+                m_column_vect[i]->Append(*src.m_column_vect[i]);
+            }
+        }
+        m_size += src.m_size;
+        src.m_size = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<ColumnBase>> m_column_vect;
+    size_t m_size = 0;
+};
+
+template <typename OBJ>
+struct MergeStore<ColumnStore<OBJ>>
+{
+    static const bool value = true;
+
+    static void Merge(ColumnStore<OBJ>& dst, ColumnStore<OBJ>& src) { dst.Merge(src); }
+};
+
+// 列只能追加, 不能按 key upsert, 增量刷新不支持 ColumnStore
+template <typename STORE>
+struct IsColumnStore : std::false_type
+{
+};
+
+template <typename OBJ>
+struct IsColumnStore<ColumnStore<OBJ>> : std::true_type
+{
+};
+
+#endif  // _DB_COLUMN_H
@@ -1,24 +1,246 @@
 #ifndef _DB_CONVERT_H
 #define _DB_CONVERT_H
 
-#include <cstdlib>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
+// DECIMAL 定点数, m_value = 实际值 * 10^SCALE
+template <int32_t SCALE>
+struct Decimal
+{
+    static_assert(SCALE >= 0 && SCALE <= 18, "decimal scale out of range");
+
+    static constexpr int64_t Factor()
+    {
+        int64_t factor = 1;
+        for (int32_t i = 0; i < SCALE; i++)
+        {
+            factor *= 10;
+        }
+        return factor;
+    }
+
+    double ToDouble() const { return static_cast<double>(m_value) / Factor(); }
+
+    bool operator==(const Decimal& other) const { return m_value == other.m_value; }
+    bool operator<(const Decimal& other) const { return m_value < other.m_value; }
+
+    int64_t m_value = 0;
+};
+
+// DATETIME/DATE/TIMESTAMP 按 UTC 转换为 epoch
+struct DateTime
+{
+    bool operator==(const DateTime& other) const { return m_second == other.m_second && m_micro == other.m_micro; }
+    bool operator<(const DateTime& other) const { return m_second < other.m_second || (m_second == other.m_second && m_micro < other.m_micro); }
+
+    int64_t m_second = 0;
+    int32_t m_micro = 0;
+};
+
+// 单元格转换, ptr 为 nullptr 表示 SQL NULL, 此时写入默认值并返回 false
 struct Convert
 {
-    static void ToData(const char* ptr, int32_t& data) { data = atoi(ptr); }
+    template <typename T>
+    static typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value, bool>::type
+    ToData(const char* ptr, size_t len, T& data)
+    {
+        data = T();
+        if (!ptr)
+        {
+            return false;
+        }
+
+        const char* end = ptr + len;
+        if (ptr != end && *ptr == '+')
+        {
+            ptr++;
+        }
+        return std::from_chars(ptr, end, data).ec == std::errc();
+    }
+
+    static bool ToData(const char* ptr, size_t len, bool& data)
+    {
+        int64_t value = 0;
+        bool ret = ToData(ptr, len, value);
+        data = value != 0;
+        return ret;
+    }
+
+    template <typename TRAITS, typename ALLOC>
+    static bool ToData(const char* ptr, size_t len, std::basic_string<char, TRAITS, ALLOC>& data)
+    {
+        if (!ptr)
+        {
+            data.clear();
+            return false;
+        }
+        data.assign(ptr, len);
+        return true;
+    }
+
+    // 直接指向单元格, 只在当前行有效
+    static bool ToData(const char* ptr, size_t len, std::string_view& data)
+    {
+        data = ptr ? std::string_view(ptr, len) : std::string_view();
+        return ptr != nullptr;
+    }
+
+    template <typename T>
+    static bool ToData(const char* ptr, size_t len, std::optional<T>& data)
+    {
+        if (!ptr)
+        {
+            data.reset();
+            return true;
+        }
+        return ToData(ptr, len, data.emplace());
+    }
+
+    // 超出 int64_t 时写入 0 并返回 false
+    template <int32_t SCALE>
+    static bool ToData(const char* ptr, size_t len, Decimal<SCALE>& data)
+    {
+        data.m_value = 0;
+        if (!ptr || len == 0)
+        {
+            return false;
+        }
+
+        const char* end = ptr + len;
+        bool negative = *ptr == '-';
+        if (*ptr == '-' || *ptr == '+')
+        {
+            ptr++;
+        }
+
+        int64_t value = 0;
+        for (; ptr != end && IsDigit(*ptr); ptr++)
+        {
+            if (!Shift(value, *ptr - '0'))
+            {
+                return false;
+            }
+        }
+
+        int32_t scale = 0;
+        if (ptr != end && *ptr == '.')
+        {
+            for (ptr++; ptr != end && IsDigit(*ptr) && scale < SCALE; ptr++, scale++)
+            {
+                if (!Shift(value, *ptr - '0'))
+                {
+                    return false;
+                }
+            }
+            // 多余的小数位四舍五入
+            if (ptr != end && IsDigit(*ptr) && *ptr >= '5')
+            {
+                if (value == INT64_MAX)
+                {
+                    return false;
+                }
+                value++;
+            }
+        }
+
+        for (; scale < SCALE; scale++)
+        {
+            if (!Shift(value, 0))
+            {
+                return false;
+            }
+        }
+        data.m_value = negative ? -value : value;
+        return true;
+    }
+
+    // YYYY-MM-DD[ HH:MM:SS[.ffffff]]
+    static bool ToData(const char* ptr, size_t len, DateTime& data)
+    {
+        data = DateTime();
+        if (!ptr || len < 10 || ptr[4] != '-' || ptr[7] != '-')
+        {
+            return false;
+        }
+
+        int32_t year = Digit(ptr, 4);
+        int32_t month = Digit(ptr + 5, 2);
+        int32_t day = Digit(ptr + 8, 2);
+        int64_t second = 0;
+        if (len >= 19 && ptr[13] == ':' && ptr[16] == ':')
+        {
+            second = Digit(ptr + 11, 2) * 3600 + Digit(ptr + 14, 2) * 60 + Digit(ptr + 17, 2);
+        }
+
+        if (len > 20 && ptr[19] == '.')
+        {
+            int32_t micro = 0;
+            size_t i = 20;
+            for (; i < len && i < 26; i++)
+            {
+                micro = micro * 10 + (ptr[i] - '0');
+            }
+            for (; i < 26; i++)
+            {
+                micro *= 10;
+            }
+            data.m_micro = micro;
+        }
 
-    static void ToData(const char* ptr, uint32_t& data) { data = atoi(ptr); }
+        // 0000-00-00 之类的零值保持为 0
+        if (year == 0 || month == 0 || day == 0)
+        {
+            return true;
+        }
+        data.m_second = DaysFromCivil(year, month, day) * 86400 + second;
+        return true;
+    }
 
-    static void ToData(const char* ptr, int64_t& data) { data = atol(ptr); }
+    template <typename T>
+    static bool ToData(const char* ptr, T& data)
+    {
+        return ToData(ptr, ptr ? strlen(ptr) : 0, data);
+    }
 
-    static void ToData(const char* ptr, uint64_t& data) { data = atol(ptr); }
+private:
+    static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
 
-    static void ToData(const char* ptr, float& data) { data = atof(ptr); }
+    // value = value * 10 + digit, 超出 int64_t 时返回 false
+    static bool Shift(int64_t& value, int32_t digit)
+    {
+        if (value > (INT64_MAX - digit) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + digit;
+        return true;
+    }
 
-    static void ToData(const char* ptr, double& data) { data = atof(ptr); }
+    static int32_t Digit(const char* ptr, size_t len)
+    {
+        int32_t value = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            value = value * 10 + (ptr[i] - '0');
+        }
+        return value;
+    }
 
-    static void ToData(const char* ptr, std::string& data) { data = ptr; }
+    static int64_t DaysFromCivil(int32_t year, int32_t month, int32_t day)
+    {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yoe = year - era * 400;
+        int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
 };
 
 #endif  // _DB_CONVERT_H
@@ -66,6 +66,16 @@ public:
         m_cond.notify_one();
     }
 
+    // 追加一个部分结果, 不计入 SetMax 设置的结果数
+    void Append(const T& res)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_queue_size++;
+        m_pop_left++;
+        m_queue.push(res);
+        m_cond.notify_one();
+    }
+
     bool IsEmpty() const { return m_res_count <= 0 && m_queue_size <= 0; }
 
     void SetMax(int64_t max)
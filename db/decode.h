@@ -0,0 +1,99 @@
+#ifndef _DB_DECODE_H
+#define _DB_DECODE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "task.h"
+
+// 流水线的解码线程, 所有查询共享一个 ThreadExecutor, 不为每个查询新建线程
+struct DecodePool
+{
+    static ThreadExecutor& Instance()
+    {
+        static ThreadExecutor executor(std::max<int32_t>(std::thread::hardware_concurrency() / 2, 1));
+        return executor;
+    }
+};
+
+// 一个子查询的解码任务: 按提交顺序在 DecodePool 上串行执行, 最多积压 depth 个, 积压满时 Push 等待
+// 所有任务执行完(Wait 返回)之前不能析构
+template <typename T>
+class DecodeStrand
+{
+public:
+    // func 返回 false 表示这个任务失败
+    DecodeStrand(size_t depth, std::function<bool(T&)> func)
+        : m_depth(std::max<size_t>(depth, 1))
+        , m_func(std::move(func))
+    {
+    }
+
+    DecodeStrand(const DecodeStrand&) = delete;
+    DecodeStrand& operator=(const DecodeStrand&) = delete;
+
+    void Push(T item)
+    {
+        {
+            std::unique_lock<std::mutex> lk(m_mut);
+            m_cond.wait(lk, [this]() { return m_queue.size() < m_depth; });
+            m_queue.push_back(std::move(item));
+            if (m_running)
+            {
+                return;
+            }
+            m_running = true;
+        }
+        DecodePool::Instance().Post([this]() { Drain(); });
+    }
+
+    // 等待所有任务执行完, 返回是否有任务失败
+    bool Wait()
+    {
+        std::unique_lock<std::mutex> lk(m_mut);
+        m_cond.wait(lk, [this]() { return !m_running && m_queue.empty(); });
+        return m_failed;
+    }
+
+private:
+    void Drain()
+    {
+        while (true)
+        {
+            T item;
+            {
+                // 在锁内通知, Wait 返回后可以立即析构
+                std::lock_guard<std::mutex> lk(m_mut);
+                if (m_queue.empty())
+                {
+                    m_running = false;
+                    m_cond.notify_all();
+                    return;
+                }
+                item = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_cond.notify_all();
+            }
+
+            if (!m_func(item))
+            {
+                std::lock_guard<std::mutex> lk(m_mut);
+                m_failed = true;
+            }
+        }
+    }
+
+    size_t m_depth;
+    std::function<bool(T&)> m_func;
+    std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::deque<T> m_queue;
+    bool m_running = false;
+    bool m_failed = false;
+};
+
+#endif  // _DB_DECODE_H
@@ -0,0 +1,76 @@
+#ifndef _DB_DRIVER_H
+#define _DB_DRIVER_H
+
+#include <mysql/mysql.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct DBConfig;
+
+// DBPool 和 Query 通过驱动访问连接和结果集; MYSQL* 和 MYSQL_RES* 只作为句柄, 由创建它的驱动解释
+class DBDriver
+{
+public:
+    virtual ~DBDriver() = default;
+
+    // 失败返回 nullptr
+    virtual MYSQL* Connect(const DBConfig* config) = 0;
+    virtual void Close(MYSQL* con) = 0;
+    // 连接正常返回 0
+    virtual int32_t Ping(MYSQL* con) = 0;
+
+    // 和 mysql_real_query 一样成功返回 0
+    virtual int32_t Query(MYSQL* con, const std::string& sql) = 0;
+    virtual MYSQL_RES* StoreResult(MYSQL* con) = 0;
+    virtual MYSQL_RES* UseResult(MYSQL* con) = 0;
+    // 和 mysql_next_result 一样: 0 还有结果集, -1 没有了, 大于 0 出错
+    virtual int32_t NextResult(MYSQL* con) = 0;
+    virtual uint32_t FieldCount(MYSQL* con) = 0;
+    virtual int32_t SetServerOption(MYSQL* con, enum_mysql_set_option option) = 0;
+    virtual uint32_t Errno(MYSQL* con) = 0;
+    virtual const char* Error(MYSQL* con) = 0;
+
+    // 列名追加到 name_vect
+    virtual void FieldName(MYSQL_RES* res, std::vector<std::string>& name_vect) = 0;
+    virtual MYSQL_ROW FetchRow(MYSQL_RES* res) = 0;
+    virtual unsigned long* FetchLengths(MYSQL_RES* res) = 0;
+    virtual void FreeResult(MYSQL_RES* res) = 0;
+
+    // 是否支持预处理语句(Statement 直接调用 mysql_stmt_*)
+    virtual bool CanPrepare() const = 0;
+
+    // 转义字符串后追加到 out, 用于拼进 sql 的引号内; 默认按 mysql_real_escape_string 的规则转义单字节字符
+    virtual void Escape(MYSQL*, std::string& out, const char* data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            switch (data[i])
+            {
+                case '\0':
+                    out.append("\\0");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\x1a':
+                    out.append("\\Z");
+                    break;
+                case '\\':
+                case '\'':
+                case '"':
+                    out.push_back('\\');
+                    out.push_back(data[i]);
+                    break;
+                default:
+                    out.push_back(data[i]);
+                    break;
+            }
+        }
+    }
+};
+
+#endif  // _DB_DRIVER_H
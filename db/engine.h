@@ -0,0 +1,597 @@
+#ifndef _DB_ENGINE_H
+#define _DB_ENGINE_H
+
+#include "pool.h"
+
+// 非阻塞接口来自 MariaDB Connector/C 的 _start/_cont 系列函数
+#if defined(MYSQL_WAIT_READ)
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cassert>
+#include "adapter.h"
+#include "event.h"
+
+// 一个请求依次执行 m_next 给出的 sql, 每个结果集和对应的 sql 交给 m_result, 全部执行完调用 m_done
+// 连接失败或断开时剩下的 sql 不再执行, m_done 的参数为 true
+struct EngineRequest
+{
+    std::function<bool(std::string&)> m_next;
+    std::function<void(MYSQL*, MYSQL_RES*, const std::string&)> m_result;
+    std::function<void(bool)> m_done;
+};
+
+// 少量线程通过事件循环驱动大量非阻塞连接, 并发查询数不再受线程数限制
+class DBEngine
+{
+public:
+    explicit DBEngine(int32_t thread_num = 1)
+    {
+        for (int32_t i = 0; i < std::max(thread_num, 1); i++)
+        {
+            m_loop_vect.emplace_back(new Loop(this));
+        }
+
+        for (auto& loop : m_loop_vect)
+        {
+            m_thread_vect.emplace_back(&DBEngine::Thread, loop.get());
+        }
+    }
+
+    // 未完成的请求(排队的和正在执行的)都按失败结束, 事件循环线程退出前调用 m_done(true)
+    ~DBEngine()
+    {
+        for (auto& loop : m_loop_vect)
+        {
+            loop->m_exit = true;
+            int64_t data = 1;
+            write(loop->m_fd, &data, sizeof(data));
+        }
+
+        for (auto& thread : m_thread_vect)
+        {
+            thread.join();
+        }
+    }
+
+    DBEngine(const DBEngine&) = delete;
+    DBEngine& operator=(const DBEngine&) = delete;
+
+    // 可以在任意线程调用, 请求在事件循环线程上执行, 回调也在事件循环线程上调用
+    void Add(EngineRequest req, const DBConfig& config)
+    {
+        auto& loop = *m_loop_vect[m_next++ % m_loop_vect.size()];
+        {
+            std::lock_guard<std::mutex> lk(loop.m_mut);
+            loop.m_inbox.emplace_back(std::move(req), std::make_shared<DBConfig>(config));
+        }
+        int64_t data = 1;
+        write(loop.m_fd, &data, sizeof(data));
+    }
+
+private:
+    struct Loop;
+    struct Slot;
+
+    enum class State
+    {
+        CONNECT,
+        QUERY,
+        STORE
+    };
+
+    // 一个非阻塞连接, 同一时间只执行一个请求
+    struct Conn
+    {
+        ~Conn()
+        {
+            event_free(m_event);
+            if (m_con)
+            {
+                mysql_close(m_con);
+            }
+        }
+
+        Loop* m_loop = nullptr;
+        Slot* m_slot = nullptr;
+        MYSQL* m_con = nullptr;
+        event* m_event = nullptr;
+        State m_state = State::CONNECT;
+        bool m_broken = false;
+        bool m_expired = false;
+        EngineRequest m_req;
+        std::string m_sql;
+        MYSQL* m_connect_ret = nullptr;
+        int32_t m_query_ret = 0;
+        MYSQL_RES* m_res = nullptr;
+    };
+
+    // 单个配置在一个事件循环上的连接
+    struct Slot
+    {
+        std::shared_ptr<DBConfig> m_config;
+        std::vector<std::unique_ptr<Conn>> m_conn_vect;
+        std::vector<Conn*> m_idle_vect;
+        std::deque<EngineRequest> m_wait_queue;
+        bool m_scheduling = false;
+        int32_t m_backoff = 0;  // 毫秒, 连接失败后翻倍, 连接成功后清零
+        std::chrono::steady_clock::time_point m_retry_time;
+    };
+
+    struct Loop
+    {
+        explicit Loop(DBEngine* engine)
+            : m_engine(engine)
+        {
+            m_base = event_base_new();
+            m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            assert(m_base && m_fd != -1);
+            m_wake = event_new(m_base, m_fd, EV_READ | EV_PERSIST, &DBEngine::OnWake, this);
+            event_add(m_wake, nullptr);
+        }
+
+        ~Loop()
+        {
+            m_slot_table.clear();
+            event_free(m_wake);
+            close(m_fd);
+            event_base_free(m_base);
+        }
+
+        DBEngine* m_engine;
+        event_base* m_base = nullptr;
+        int32_t m_fd = -1;
+        event* m_wake = nullptr;
+        std::atomic<bool> m_exit{false};
+        std::mutex m_mut;
+        std::vector<std::pair<EngineRequest, std::shared_ptr<DBConfig>>> m_inbox;
+        std::map<std::string, std::unique_ptr<Slot>> m_slot_table;
+    };
+
+    static void Thread(Loop* loop)
+    {
+        event_base_dispatch(loop->m_base);
+        loop->m_engine->Drain(*loop);
+    }
+
+    // 事件循环退出后结束所有未完成的请求, 回调中新加入的请求也一起结束
+    void Drain(Loop& loop)
+    {
+        for (auto& item : loop.m_slot_table)
+        {
+            Slot& slot = *item.second;
+            Abort(slot);
+            for (auto& conn : slot.m_conn_vect)
+            {
+                auto done = std::move(conn->m_req.m_done);
+                conn->m_req = EngineRequest();
+                if (done)
+                {
+                    done(true);
+                }
+            }
+        }
+
+        while (true)
+        {
+            std::vector<std::pair<EngineRequest, std::shared_ptr<DBConfig>>> inbox;
+            {
+                std::lock_guard<std::mutex> lk(loop.m_mut);
+                inbox.swap(loop.m_inbox);
+            }
+            if (inbox.empty())
+            {
+                return;
+            }
+
+            for (auto& item : inbox)
+            {
+                if (item.first.m_done)
+                {
+                    item.first.m_done(true);
+                }
+            }
+        }
+    }
+
+    static void OnWake(evutil_socket_t fd, short, void* ptr)
+    {
+        int64_t data;
+        read(fd, &data, sizeof(data));
+
+        auto* loop = static_cast<Loop*>(ptr);
+        if (loop->m_exit)
+        {
+            event_base_loopbreak(loop->m_base);
+            return;
+        }
+
+        std::vector<std::pair<EngineRequest, std::shared_ptr<DBConfig>>> inbox;
+        {
+            std::lock_guard<std::mutex> lk(loop->m_mut);
+            inbox.swap(loop->m_inbox);
+        }
+
+        for (auto& item : inbox)
+        {
+            Slot& slot = loop->m_engine->GetSlot(*loop, item.second);
+            slot.m_wait_queue.emplace_back(std::move(item.first));
+            loop->m_engine->Schedule(*loop, slot);
+        }
+    }
+
+    // 配置变化时旧连接执行完当前请求后关闭
+    Slot& GetSlot(Loop& loop, const std::shared_ptr<DBConfig>& config)
+    {
+        auto& slot = loop.m_slot_table[config->m_conf_name];
+        if (!slot)
+        {
+            slot.reset(new Slot());
+            slot->m_config = config;
+        }
+        else if (!slot->m_config->Equal(*config))
+        {
+            slot->m_config = config;
+            slot->m_backoff = 0;
+            slot->m_retry_time = std::chrono::steady_clock::time_point();
+            for (auto* conn : slot->m_idle_vect)
+            {
+                Remove(*slot, conn);
+            }
+            slot->m_idle_vect.clear();
+            for (auto& conn : slot->m_conn_vect)
+            {
+                conn->m_expired = true;
+            }
+        }
+        return *slot;
+    }
+
+    // 把排队的请求分给空闲连接, 连接数未达上限时新建连接; m_max_connect 平均分到各个事件循环, 不限制时每个事件循环 m_loop_connect 个
+    void Schedule(Loop& loop, Slot& slot)
+    {
+        // 同步完成的请求在 Finish 中只归还连接, 由这里的循环继续分配, 避免递归
+        if (slot.m_scheduling)
+        {
+            return;
+        }
+
+        slot.m_scheduling = true;
+        size_t loop_num = m_loop_vect.size();
+        int32_t total = slot.m_config->m_max_connect;
+        size_t max_connect = total > 0 ? std::max<size_t>((total + loop_num - 1) / loop_num, 1) : m_loop_connect;
+        while (!slot.m_wait_queue.empty())
+        {
+            Conn* conn = nullptr;
+            if (!slot.m_idle_vect.empty())
+            {
+                conn = slot.m_idle_vect.back();
+                slot.m_idle_vect.pop_back();
+            }
+            else if (slot.m_conn_vect.size() < max_connect)
+            {
+                // 连接失败后的退避期间不新建连接
+                conn = std::chrono::steady_clock::now() < slot.m_retry_time ? nullptr : NewConn(loop, slot);
+                if (!conn && slot.m_conn_vect.empty())
+                {
+                    // 没有连接会归还, 排队的请求都按失败结束
+                    Abort(slot);
+                    break;
+                }
+                if (!conn)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                break;
+            }
+
+            conn->m_req = std::move(slot.m_wait_queue.front());
+            slot.m_wait_queue.pop_front();
+            if (conn->m_state != State::CONNECT)
+            {
+                Next(*conn);
+            }
+        }
+        slot.m_scheduling = false;
+    }
+
+    Conn* NewConn(Loop& loop, Slot& slot)
+    {
+        MYSQL* con = mysql_init(nullptr);
+        if (!con)
+        {
+            Backoff(slot);
+            return nullptr;
+        }
+
+        mysql_options(con, MYSQL_OPT_NONBLOCK, nullptr);
+        mysql_options(con, MYSQL_SET_CHARSET_NAME, "utf8");
+        mysql_options(con, MYSQL_INIT_COMMAND, "SET NAMES utf8");
+        mysql_options(con, MYSQL_OPT_CONNECT_TIMEOUT, &m_connect_timeout);
+
+        auto conn = std::unique_ptr<Conn>(new Conn());
+        conn->m_loop = &loop;
+        conn->m_slot = &slot;
+        conn->m_con = con;
+        conn->m_event = event_new(loop.m_base, -1, 0, &DBEngine::OnEvent, conn.get());
+        conn->m_state = State::CONNECT;
+        slot.m_conn_vect.emplace_back(std::move(conn));
+
+        Conn* ptr = slot.m_conn_vect.back().get();
+        const DBConfig& config = *slot.m_config;
+        int32_t status = mysql_real_connect_start(&ptr->m_connect_ret, con, config.m_host.c_str(), config.m_user.c_str(), config.m_password.c_str(),
+                                                  config.m_db.c_str(), config.m_port, nullptr, 0);
+        if (status)
+        {
+            Wait(*ptr, status);
+        }
+        else
+        {
+            // 调用方还没有分配请求, 连接结果在分配后处理
+            event_active(ptr->m_event, 0, 0);
+        }
+        return ptr;
+    }
+
+    static void OnEvent(evutil_socket_t, short ev, void* ptr)
+    {
+        auto* conn = static_cast<Conn*>(ptr);
+        int32_t ready = 0;
+        if (ev & EV_READ)
+        {
+            ready |= MYSQL_WAIT_READ;
+        }
+        if (ev & EV_WRITE)
+        {
+            ready |= MYSQL_WAIT_WRITE;
+        }
+        if (ev & EV_TIMEOUT)
+        {
+            ready |= MYSQL_WAIT_TIMEOUT;
+        }
+        conn->m_loop->m_engine->Resume(*conn, ready);
+    }
+
+    // ready == 0 表示上一步已经完成, 直接处理结果
+    void Resume(Conn& conn, int32_t ready)
+    {
+        int32_t status = 0;
+        switch (conn.m_state)
+        {
+            case State::CONNECT:
+                if (ready)
+                {
+                    status = mysql_real_connect_cont(&conn.m_connect_ret, conn.m_con, ready);
+                }
+                if (!status)
+                {
+                    OnConnect(conn);
+                    return;
+                }
+                break;
+            case State::QUERY:
+                status = mysql_real_query_cont(&conn.m_query_ret, conn.m_con, ready);
+                if (!status)
+                {
+                    if (OnQuery(conn))
+                    {
+                        Next(conn);
+                    }
+                    return;
+                }
+                break;
+            case State::STORE:
+                status = mysql_store_result_cont(&conn.m_res, conn.m_con, ready);
+                if (!status)
+                {
+                    OnStore(conn);
+                    Next(conn);
+                    return;
+                }
+                break;
+        }
+        Wait(conn, status);
+    }
+
+    void Wait(Conn& conn, int32_t status)
+    {
+        short what = 0;
+        if (status & MYSQL_WAIT_READ)
+        {
+            what |= EV_READ;
+        }
+        if (status & MYSQL_WAIT_WRITE)
+        {
+            what |= EV_WRITE;
+        }
+
+        timeval tv{};
+        timeval* timeout = nullptr;
+        if (status & MYSQL_WAIT_TIMEOUT)
+        {
+            uint32_t ms = mysql_get_timeout_value_ms(conn.m_con);
+            tv.tv_sec = ms / 1000;
+            tv.tv_usec = (ms % 1000) * 1000;
+            timeout = &tv;
+        }
+
+        event_assign(conn.m_event, conn.m_loop->m_base, mysql_get_socket(conn.m_con), what, &DBEngine::OnEvent, &conn);
+        event_add(conn.m_event, timeout);
+    }
+
+    void OnConnect(Conn& conn)
+    {
+        if (!conn.m_connect_ret)
+        {
+            Log::Warn("%s", mysql_error(conn.m_con));
+            Backoff(*conn.m_slot);
+            conn.m_broken = true;
+            Finish(conn);
+            return;
+        }
+
+        conn.m_slot->m_backoff = 0;
+        conn.m_state = State::QUERY;
+        Next(conn);
+    }
+
+    // 执行请求的下一条 sql, 没有了就结束请求; 同步完成的 sql 在循环中继续, 不递归
+    void Next(Conn& conn)
+    {
+        while (true)
+        {
+            if (conn.m_broken || !conn.m_req.m_next || !conn.m_req.m_next(conn.m_sql))
+            {
+                Finish(conn);
+                return;
+            }
+
+            conn.m_state = State::QUERY;
+            int32_t status = mysql_real_query_start(&conn.m_query_ret, conn.m_con, conn.m_sql.data(), conn.m_sql.size());
+            if (status)
+            {
+                Wait(conn, status);
+                return;
+            }
+
+            if (!OnQuery(conn))
+            {
+                return;
+            }
+        }
+    }
+
+    // 开始读取结果集, 需要等待时返回 false
+    bool OnQuery(Conn& conn)
+    {
+        if (conn.m_query_ret != 0)
+        {
+            Fail(conn);
+            return true;
+        }
+
+        conn.m_state = State::STORE;
+        int32_t status = mysql_store_result_start(&conn.m_res, conn.m_con);
+        if (status)
+        {
+            Wait(conn, status);
+            return false;
+        }
+        OnStore(conn);
+        return true;
+    }
+
+    void OnStore(Conn& conn)
+    {
+        if (conn.m_res)
+        {
+            if (conn.m_req.m_result)
+            {
+                conn.m_req.m_result(conn.m_con, conn.m_res, conn.m_sql);
+            }
+            mysql_free_result(conn.m_res);
+            conn.m_res = nullptr;
+        }
+        else if (mysql_errno(conn.m_con) != 0)
+        {
+            Fail(conn);
+        }
+    }
+
+    // 连接断开后不能继续使用, 请求剩下的 sql 不再执行
+    void Fail(Conn& conn)
+    {
+        Log::Warn("%s", mysql_error(conn.m_con));
+        uint32_t err = mysql_errno(conn.m_con);
+        if (err == 2006 || err == 2013)
+        {
+            conn.m_broken = true;
+        }
+    }
+
+    // 连接失败后不再为每个排队的请求重连, 等待时间翻倍直到 m_max_backoff
+    static void Backoff(Slot& slot)
+    {
+        slot.m_backoff = slot.m_backoff > 0 ? std::min(slot.m_backoff * 2, m_max_backoff) : m_min_backoff;
+        slot.m_retry_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(slot.m_backoff);
+    }
+
+    static void Abort(Slot& slot)
+    {
+        std::deque<EngineRequest> wait_queue;
+        wait_queue.swap(slot.m_wait_queue);
+        for (auto& req : wait_queue)
+        {
+            if (req.m_done)
+            {
+                req.m_done(true);
+            }
+        }
+    }
+
+    // 结束当前请求并归还连接, 之后不能再访问 conn
+    void Finish(Conn& conn)
+    {
+        auto done = std::move(conn.m_req.m_done);
+        bool failed = conn.m_broken;
+        conn.m_req = EngineRequest();
+        Loop& loop = *conn.m_loop;
+        Slot& slot = *conn.m_slot;
+        if (conn.m_broken || conn.m_expired)
+        {
+            Remove(slot, &conn);
+        }
+        else
+        {
+            slot.m_idle_vect.emplace_back(&conn);
+        }
+
+        if (done)
+        {
+            done(failed);
+        }
+        Schedule(loop, slot);
+    }
+
+    void Remove(Slot& slot, Conn* conn)
+    {
+        for (auto iter = slot.m_conn_vect.begin(); iter != slot.m_conn_vect.end(); iter++)
+        {
+            if (iter->get() == conn)
+            {
+                slot.m_conn_vect.erase(iter);
+                return;
+            }
+        }
+    }
+
+    static constexpr size_t m_loop_connect = 4;
+    static constexpr int32_t m_min_backoff = 100;   // 毫秒
+    static constexpr int32_t m_max_backoff = 8000;  // 毫秒
+    int32_t m_connect_timeout = 8;
+    std::vector<std::unique_ptr<Loop>> m_loop_vect;
+    std::vector<std::thread> m_thread_vect;
+    std::atomic<size_t> m_next{0};
+};
+
+#else
+
+#include <type_traits>
+
+// 客户端库没有非阻塞接口(不是 MariaDB Connector/C)时 DBEngine 不可用, 构造时编译报错
+class DBEngine
+{
+public:
+    template <typename T = int32_t>
+    explicit DBEngine(T = 1)
+    {
+        static_assert(!std::is_same<T, T>::value, "DBEngine needs the non-blocking API of MariaDB Connector/C (MYSQL_WAIT_READ)");
+    }
+};
+
+#endif  // MYSQL_WAIT_READ
+
+#endif  // _DB_ENGINE_H
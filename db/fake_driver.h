@@ -0,0 +1,266 @@
+#ifndef _DB_FAKE_DRIVER_H
+#define _DB_FAKE_DRIVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cache.h"
+#include "driver.h"
+
+// 进程内的假数据库, 不需要 mysql 服务端: 按 sql 返回录制的或生成的结果集, 可以模拟网络延迟
+// 用于在任何机器上压测和回归测试 sql 生成、解码、转换和调度; 不支持预处理语句
+class FakeDriver : public DBDriver
+{
+public:
+    using result_t = std::shared_ptr<const CacheResult>;
+    // 没有录制的 sql 交给 handler, 返回空时查询出错; 多个工作线程会同时调用
+    using handler_t = std::function<result_t(const std::string&)>;
+
+    static constexpr uint32_t m_no_result = 1146;
+
+    // rows 行 columns 列, 列名为 c0, c1, ...; 第一列为行号, 其他列为 width 位的数字
+    static result_t Generate(size_t rows, size_t columns, size_t width = 8)
+    {
+        std::vector<std::string> field_vect;
+        for (size_t i = 0; i < columns; i++)
+        {
+            field_vect.emplace_back("c" + std::to_string(i));
+        }
+
+        auto result = std::make_shared<CacheResult>(std::move(field_vect));
+        std::vector<std::string> cell_vect(columns);
+        std::vector<char*> row(columns);
+        std::vector<unsigned long> length(columns);
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t k = 0; k < columns; k++)
+            {
+                std::string& cell = cell_vect[k];
+                cell = std::to_string(k == 0 ? i : i * columns + k);
+                if (k > 0 && cell.size() < width)
+                {
+                    cell.insert(0, width - cell.size(), '0');
+                }
+                else if (k > 0)
+                {
+                    cell.erase(0, cell.size() - width);
+                }
+                row[k] = &cell[0];
+                length[k] = cell.size();
+            }
+            result->AddRow(row.data(), length.data());
+        }
+        result->Finish();
+        return result;
+    }
+
+    // 录制的结果集, nullptr 表示 NULL
+    static result_t Make(std::vector<std::string> field_vect, const std::vector<std::vector<const char*>>& row_vect)
+    {
+        auto result = std::make_shared<CacheResult>(std::move(field_vect));
+        std::vector<unsigned long> length(result->m_column);
+        for (auto& row : row_vect)
+        {
+            for (size_t i = 0; i < result->m_column; i++)
+            {
+                length[i] = row[i] ? strlen(row[i]) : 0;
+            }
+            result->AddRow(const_cast<char**>(row.data()), length.data());
+        }
+        result->Finish();
+        return result;
+    }
+
+    void Record(const std::string& sql, result_t result)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_table[sql] = std::move(result);
+    }
+
+    // 在开始查询前设置
+    void SetHandler(handler_t handler) { m_handler = std::move(handler); }
+
+    // 每次往返(多语句打包时每个包一次)和每次建立连接的等待时间
+    void SetLatency(std::chrono::microseconds query, std::chrono::microseconds connect = std::chrono::microseconds(0))
+    {
+        m_query_latency = query;
+        m_connect_latency = connect;
+    }
+
+    uint64_t QueryCount() const { return m_query_count; }
+
+    uint64_t ConnectCount() const { return m_connect_count; }
+
+    MYSQL* Connect(const DBConfig*) override
+    {
+        m_connect_count++;
+        Sleep(m_connect_latency);
+        return reinterpret_cast<MYSQL*>(new Connection());
+    }
+
+    void Close(MYSQL* con) override { delete Cast(con); }
+
+    int32_t Ping(MYSQL*) override { return 0; }
+
+    // 打开多语句时按 ';' 拆分, sql 的字符串中不能有 ';'; 第 i 条出错时只返回前 i 条的结果集, 和服务端一样
+    int32_t Query(MYSQL* con, const std::string& sql) override
+    {
+        m_query_count++;
+        Sleep(m_query_latency);
+        Connection* connection = Cast(con);
+        connection->m_result_vect.clear();
+        connection->m_next = 0;
+        connection->m_fail = false;
+        connection->m_errno = 0;
+        connection->m_error.clear();
+
+        size_t start = 0;
+        while (start <= sql.size())
+        {
+            size_t end = connection->m_multi ? sql.find(';', start) : std::string::npos;
+            end = end == std::string::npos ? sql.size() : end;
+            std::string statement = sql.substr(start, end - start);
+            result_t result = Find(statement);
+            if (!result)
+            {
+                connection->m_fail = true;
+                connection->m_error = "fake driver: no result for " + statement;
+                break;
+            }
+            connection->m_result_vect.push_back(std::move(result));
+            start = end + 1;
+        }
+
+        if (connection->m_result_vect.empty())
+        {
+            connection->m_errno = m_no_result;
+            return 1;
+        }
+        return 0;
+    }
+
+    MYSQL_RES* StoreResult(MYSQL* con) override
+    {
+        Connection* connection = Cast(con);
+        if (connection->m_next >= connection->m_result_vect.size())
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<MYSQL_RES*>(new Result{connection->m_result_vect[connection->m_next], 0});
+    }
+
+    MYSQL_RES* UseResult(MYSQL* con) override { return StoreResult(con); }
+
+    int32_t NextResult(MYSQL* con) override
+    {
+        Connection* connection = Cast(con);
+        if (++connection->m_next < connection->m_result_vect.size())
+        {
+            return 0;
+        }
+        if (connection->m_fail)
+        {
+            connection->m_errno = m_no_result;
+            return 1;
+        }
+        return -1;
+    }
+
+    uint32_t FieldCount(MYSQL* con) override
+    {
+        Connection* connection = Cast(con);
+        return connection->m_next < connection->m_result_vect.size() ? connection->m_result_vect[connection->m_next]->m_column : 0;
+    }
+
+    int32_t SetServerOption(MYSQL* con, enum_mysql_set_option option) override
+    {
+        Cast(con)->m_multi = option == MYSQL_OPTION_MULTI_STATEMENTS_ON;
+        return 0;
+    }
+
+    uint32_t Errno(MYSQL* con) override { return Cast(con)->m_errno; }
+
+    const char* Error(MYSQL* con) override { return Cast(con)->m_error.c_str(); }
+
+    void FieldName(MYSQL_RES* res, std::vector<std::string>& name_vect) override
+    {
+        auto& field_vect = Cast(res)->m_result->m_field_vect;
+        name_vect.insert(name_vect.end(), field_vect.begin(), field_vect.end());
+    }
+
+    MYSQL_ROW FetchRow(MYSQL_RES* res) override
+    {
+        Result* result = Cast(res);
+        return result->m_row < result->m_result->RowCount() ? result->m_result->Row(result->m_row++) : nullptr;
+    }
+
+    unsigned long* FetchLengths(MYSQL_RES* res) override
+    {
+        Result* result = Cast(res);
+        return result->m_row > 0 ? result->m_result->Length(result->m_row - 1) : nullptr;
+    }
+
+    void FreeResult(MYSQL_RES* res) override { delete Cast(res); }
+
+    bool CanPrepare() const override { return false; }
+
+private:
+    struct Connection
+    {
+        std::vector<result_t> m_result_vect;
+        size_t m_next = 0;
+        bool m_fail = false;
+        bool m_multi = false;
+        uint32_t m_errno = 0;
+        std::string m_error;
+    };
+
+    // 行直接指向共享的结果集, 不复制
+    struct Result
+    {
+        result_t m_result;
+        size_t m_row;
+    };
+
+    static Connection* Cast(MYSQL* con) { return reinterpret_cast<Connection*>(con); }
+
+    static Result* Cast(MYSQL_RES* res) { return reinterpret_cast<Result*>(res); }
+
+    static void Sleep(std::chrono::microseconds latency)
+    {
+        if (latency.count() > 0)
+        {
+            std::this_thread::sleep_for(latency);
+        }
+    }
+
+    result_t Find(const std::string& sql)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            auto iter = m_table.find(sql);
+            if (iter != m_table.end())
+            {
+                return iter->second;
+            }
+        }
+        return m_handler ? m_handler(sql) : nullptr;
+    }
+
+    std::mutex m_mut;
+    std::unordered_map<std::string, result_t> m_table;
+    handler_t m_handler;
+    std::chrono::microseconds m_query_latency{0};
+    std::chrono::microseconds m_connect_latency{0};
+    std::atomic<uint64_t> m_query_count{0};
+    std::atomic<uint64_t> m_connect_count{0};
+};
+
+#endif  // _DB_FAKE_DRIVER_H
@@ -0,0 +1,77 @@
+#ifndef _DB_FLIGHT_H
+#define _DB_FLIGHT_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 相同 key 的并发请求只执行一次, 第一个请求执行, 其余请求等待它的结果
+template <typename T>
+class SingleFlight
+{
+public:
+    using callback_t = std::function<void(const T&)>;
+
+    static SingleFlight& Instance()
+    {
+        static SingleFlight flight;
+        return flight;
+    }
+
+    // 返回 true 表示需要执行并在完成后调用 Done, 否则 callback 在执行者完成时调用
+    bool Join(const std::string& key, callback_t callback)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        auto iter = m_wait_table.find(key);
+        if (iter != m_wait_table.end())
+        {
+            iter->second.emplace_back(std::move(callback));
+            return false;
+        }
+        m_wait_table.emplace(key, std::vector<callback_t>());
+        return true;
+    }
+
+    void Done(const std::string& key, const T& value)
+    {
+        std::vector<callback_t> callback_vect;
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            auto iter = m_wait_table.find(key);
+            if (iter == m_wait_table.end())
+            {
+                return;
+            }
+            callback_vect.swap(iter->second);
+            m_wait_table.erase(iter);
+        }
+
+        for (auto& callback : callback_vect)
+        {
+            callback(value);
+        }
+    }
+
+private:
+    std::mutex m_mut;
+    std::unordered_map<std::string, std::vector<callback_t>> m_wait_table;
+};
+
+// 一次查询中已经执行过的 sql, 所有子查询共享
+struct SqlFilter
+{
+    bool Insert(const std::string& sql)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        return m_sql_set.insert(sql).second;
+    }
+
+    std::mutex m_mut;
+    std::unordered_set<std::string> m_sql_set;
+};
+
+#endif  // _DB_FLIGHT_H
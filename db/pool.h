@@ -2,13 +2,20 @@
 #define _DB_POOL_H
 
 #include <mysql/mysql.h>
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
+#include <vector>
+#include "adapter.h"
+#include "driver.h"
+#include "statement.h"
 
 struct DBConfig
 {
@@ -18,6 +25,10 @@ struct DBConfig
     std::string m_db;
     std::string m_host;
     int32_t m_port = 0;
+    int32_t m_min_connect = 0;
+    int32_t m_max_connect = 0;       // 0 表示不限制, DBPool 的并发数就是线程数
+    int32_t m_idle_timeout = 60;     // 秒
+    int32_t m_wait_timeout = 30000;  // 毫秒
 
     bool Equal(const DBConfig& config) const
     {
@@ -25,54 +36,105 @@ struct DBConfig
                && m_password == config.m_password
                && m_db == config.m_db
                && m_host == config.m_host
-               && m_port == config.m_port;
+               && m_port == config.m_port
+               && m_min_connect == config.m_min_connect
+               && m_max_connect == config.m_max_connect
+               && m_idle_timeout == config.m_idle_timeout
+               && m_wait_timeout == config.m_wait_timeout;
     }
 };
 
-struct SQLConnect
+// 默认驱动, 直接调用 mysql 客户端库
+class MySqlDriver : public DBDriver
 {
-    void SetConnect(MYSQL* con, std::shared_ptr<DBConfig>& config)
+public:
+    static std::shared_ptr<DBDriver> Instance()
     {
-        if (!m_con)
+        static std::shared_ptr<DBDriver> driver = std::make_shared<MySqlDriver>();
+        return driver;
+    }
+
+    MYSQL* Connect(const DBConfig* config) override
+    {
+        MYSQL* con = mysql_init(nullptr);
+        if (!con)
         {
-            mysql_close(m_con);
+            return nullptr;
         }
 
-        m_con = con;
-        m_is_connect = true;
-        m_reconnect_count = 0;
-        m_config = config;
+        SetOptions(con);
+        if (!mysql_real_connect(con, config->m_host.c_str(), config->m_user.c_str(), config->m_password.c_str(), config->m_db.c_str(), config->m_port, nullptr, 0))
+        {
+            mysql_close(con);
+            return nullptr;
+        }
+        return con;
     }
 
-    void TestConnect()
+    void Close(MYSQL* con) override
+    {
+        StatementCache::Instance().Close(con);
+        mysql_close(con);
+    }
+
+    int32_t Ping(MYSQL* con) override { return mysql_ping(con); }
+
+    int32_t Query(MYSQL* con, const std::string& sql) override { return mysql_real_query(con, sql.data(), sql.size()); }
+
+    MYSQL_RES* StoreResult(MYSQL* con) override { return mysql_store_result(con); }
+
+    MYSQL_RES* UseResult(MYSQL* con) override { return mysql_use_result(con); }
+
+    int32_t NextResult(MYSQL* con) override { return mysql_next_result(con); }
+
+    uint32_t FieldCount(MYSQL* con) override { return mysql_field_count(con); }
+
+    int32_t SetServerOption(MYSQL* con, enum_mysql_set_option option) override { return mysql_set_server_option(con, option); }
+
+    uint32_t Errno(MYSQL* con) override { return mysql_errno(con); }
+
+    const char* Error(MYSQL* con) override { return mysql_error(con); }
+
+    void FieldName(MYSQL_RES* res, std::vector<std::string>& name_vect) override
     {
-        m_is_connect = mysql_ping(m_con) == 0;
-        if (!m_is_connect && !m_reconnect(m_con))
+        MYSQL_FIELD* field;
+        while ((field = mysql_fetch_field(res)))
         {
-            m_reconnect_count++;
-            return;
+            name_vect.emplace_back(field->name);
         }
-        m_reconnect_count = 0;
     }
 
-    bool IsVaild() const
+    MYSQL_ROW FetchRow(MYSQL_RES* res) override { return mysql_fetch_row(res); }
+
+    unsigned long* FetchLengths(MYSQL_RES* res) override { return mysql_fetch_lengths(res); }
+
+    void FreeResult(MYSQL_RES* res) override { mysql_free_result(res); }
+
+    bool CanPrepare() const override { return true; }
+
+    // 按连接的字符集转义
+    void Escape(MYSQL* con, std::string& out, const char* data, size_t len) override
     {
-        return m_config.lock() != nullptr;
+        size_t pos = out.size();
+        out.resize(pos + len * 2 + 1);
+        unsigned long size = mysql_real_escape_string(con, &out[pos], data, len);
+        out.resize(pos + size);
     }
 
-    ~SQLConnect()
+private:
+    void SetOptions(MYSQL* con)
     {
-        mysql_close(m_con);
+        mysql_options(con, MYSQL_SET_CHARSET_NAME, "utf8");
+        mysql_options(con, MYSQL_INIT_COMMAND, "SET NAMES utf8");
+        mysql_options(con, MYSQL_OPT_CONNECT_TIMEOUT, &m_connect_timeout);
+        mysql_options(con, MYSQL_OPT_RECONNECT, &m_reconnect);
+        mysql_options(con, MYSQL_OPT_COMPRESS, nullptr);
     }
 
-    bool m_is_connect = false;
-    int32_t m_reconnect_count = 0;
-    MYSQL* m_con = nullptr;
-    std::function<bool(MYSQL*)> m_reconnect;
-    std::weak_ptr<DBConfig> m_config;
+    int32_t m_connect_timeout = 8;
+    int32_t m_reconnect = 1;
 };
 
-
 struct DBRequest
 {
     DBRequest() = default;
@@ -87,22 +149,280 @@ struct DBRequest
     std::shared_ptr<DBConfig> m_db;
     std::function<void(MYSQL*)> m_func;
     bool m_reconnect = false;
+    bool m_ready = false;                                 // 连接池已经分配了连接, m_con 为空表示等待超时
+    MYSQL* m_con = nullptr;
+    std::chrono::steady_clock::time_point m_deadline{};  // 第一次排队等待连接时设置
+};
+
+// 单个配置的连接池, 所有工作线程共享
+class ConnectPool
+{
+public:
+    ConnectPool(std::shared_ptr<DBConfig> config, DBDriver* driver)
+        : m_config(std::move(config))
+        , m_driver(driver)
+    {
+    }
+
+    ~ConnectPool()
+    {
+        for (auto& idle : m_idle_queue)
+        {
+            m_driver->Close(idle.m_con);
+        }
+    }
+
+    // 优先复用空闲连接, 未达上限时新建(连接失败时 con 为空), 返回 true
+    // 否则请求移入等待队列, 返回 false, 由 Checkin 或 Expire 交还给调用者
+    bool Checkout(DBRequest& req, MYSQL*& con)
+    {
+        std::unique_lock<std::mutex> lk(m_mut);
+        if (!m_idle_queue.empty())
+        {
+            con = m_idle_queue.back().m_con;
+            m_idle_queue.pop_back();
+            return true;
+        }
+
+        if (!m_retired && m_config->m_max_connect > 0 && m_total >= m_config->m_max_connect)
+        {
+            if (req.m_deadline == std::chrono::steady_clock::time_point{})
+            {
+                req.m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_config->m_wait_timeout);
+            }
+            m_wait_queue.push_back(std::move(req));
+            return false;
+        }
+
+        m_total++;
+        lk.unlock();
+        con = m_driver->Connect(m_config.get());
+        if (!con)
+        {
+            lk.lock();
+            m_total--;
+        }
+        return true;
+    }
+
+    // 有排队的请求时连接直接交给最早的一个, 通过 next 返回
+    bool Checkin(MYSQL* con, DBRequest& next)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if (!m_wait_queue.empty())
+        {
+            next = std::move(m_wait_queue.front());
+            m_wait_queue.pop_front();
+            next.m_ready = true;
+            next.m_con = con;
+            return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        m_idle_queue.push_back(Idle{con, now, now});
+        return false;
+    }
+
+    // 取出可以继续执行的排队请求: 有空闲连接的带上连接, 连接数低于上限的重新 Checkout, 等待超时的连接为空
+    std::vector<DBRequest> Expire()
+    {
+        std::vector<DBRequest> req_vect;
+        std::lock_guard<std::mutex> lk(m_mut);
+        auto now = std::chrono::steady_clock::now();
+        int32_t spare = m_config->m_max_connect > 0 ? m_config->m_max_connect - m_total : static_cast<int32_t>(m_wait_queue.size());
+        while (!m_wait_queue.empty())
+        {
+            DBRequest& req = m_wait_queue.front();
+            if (!m_idle_queue.empty())
+            {
+                req.m_ready = true;
+                req.m_con = m_idle_queue.back().m_con;
+                m_idle_queue.pop_back();
+            }
+            else if (spare > 0)
+            {
+                spare--;
+            }
+            else if (req.m_deadline <= now)
+            {
+                req.m_ready = true;
+                req.m_con = nullptr;
+            }
+            else
+            {
+                break;
+            }
+            req_vect.push_back(std::move(req));
+            m_wait_queue.pop_front();
+        }
+        return req_vect;
+    }
+
+    // 取出所有排队的请求, 连接池被替换时交给新的连接池, 之后不再排队
+    std::vector<DBRequest> TakeWaiting()
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_retired = true;
+        std::vector<DBRequest> req_vect(std::make_move_iterator(m_wait_queue.begin()), std::make_move_iterator(m_wait_queue.end()));
+        m_wait_queue.clear();
+        return req_vect;
+    }
+
+    // 关闭超时的空闲连接(保留 m_min_connect 个), 检测较长时间没有检测过的空闲连接, 不足最小连接数时补齐
+    // 只取出需要处理的连接, 其他空闲连接在检测期间仍然可以使用
+    void Maintain()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::seconds(m_config->m_idle_timeout);
+        auto ping_interval = std::chrono::seconds(m_ping_interval);
+        std::deque<Idle> idle_queue;
+        int32_t total = 0;
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            total = m_total;
+            for (auto iter = m_idle_queue.begin(); iter != m_idle_queue.end();)
+            {
+                if (now - iter->m_time > timeout || now - iter->m_ping > ping_interval)
+                {
+                    idle_queue.push_back(*iter);
+                    iter = m_idle_queue.erase(iter);
+                    continue;
+                }
+                iter++;
+            }
+        }
+
+        int32_t closed = 0;
+        for (auto iter = idle_queue.begin(); iter != idle_queue.end();)
+        {
+            bool expire = now - iter->m_time > timeout && total - closed > m_config->m_min_connect;
+            if (expire || m_driver->Ping(iter->m_con) != 0)
+            {
+                m_driver->Close(iter->m_con);
+                iter = idle_queue.erase(iter);
+                closed++;
+                continue;
+            }
+            iter->m_ping = now;
+            iter++;
+        }
+
+        for (int32_t i = total - closed; i < m_config->m_min_connect; i++)
+        {
+            MYSQL* con = m_driver->Connect(m_config.get());
+            if (!con)
+            {
+                break;
+            }
+            idle_queue.push_back(Idle{con, now, now});
+            closed--;
+        }
+
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_total -= closed;
+        m_idle_queue.insert(m_idle_queue.begin(), idle_queue.begin(), idle_queue.end());
+    }
+
+    const std::shared_ptr<DBConfig>& Config() const { return m_config; }
+
+private:
+    struct Idle
+    {
+        MYSQL* m_con;
+        std::chrono::steady_clock::time_point m_time;  // 归还的时间
+        std::chrono::steady_clock::time_point m_ping;  // 上次检测的时间
+    };
+
+    static constexpr int32_t m_ping_interval = 10;  // 秒
+
+    std::shared_ptr<DBConfig> m_config;
+    DBDriver* m_driver;
+    std::mutex m_mut;
+    std::deque<Idle> m_idle_queue;
+    std::deque<DBRequest> m_wait_queue;
+    int32_t m_total = 0;
+    bool m_retired = false;
+};
+
+// 每个工作线程一个请求队列, 空闲时从其他线程的队列尾部窃取请求
+struct DBWorker
+{
+    std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::deque<DBRequest> m_queue;
+    std::atomic<size_t> m_size{0};
+    std::atomic<bool> m_idle{false};
+    bool m_notified = false;
 };
 
 class DBPool
 {
 public:
-    explicit DBPool(int32_t parallel = 1)
+    // driver 为空时使用 MySqlDriver
+    explicit DBPool(int32_t parallel = 1, std::shared_ptr<DBDriver> driver = nullptr)
         : m_exit(false)
+        , m_driver(driver ? std::move(driver) : MySqlDriver::Instance())
         , m_queue_size(0)
     {
         for (int32_t i = 0; i < parallel; i++)
         {
-            m_db_thread.emplace_back(std::bind(&DBPool::Thread, this));
+            m_worker_vect.emplace_back(new DBWorker());
+        }
+
+        for (int32_t i = 0; i < parallel; i++)
+        {
+            m_db_thread.emplace_back(std::bind(&DBPool::Thread, this, i));
         }
     }
 
+    // 取不到连接时 exec 收到空指针; exec 直接调用 mysql_*, 只能用于 MySqlDriver, 其他驱动的连接池返回 false
     bool Add(const std::function<void(MYSQL*)>& exec, const DBConfig& config)
+    {
+        if (!dynamic_cast<MySqlDriver*>(m_driver.get()))
+        {
+            Log::Warn("%s", "DBPool::Add without driver on a non-MySQL driver");
+            return false;
+        }
+        return Push(exec, config);
+    }
+
+    // 连接通过 driver 访问, 适用于任何驱动
+    bool Add(const std::function<void(MYSQL*, DBDriver*)>& exec, const DBConfig& config)
+    {
+        DBDriver* driver = m_driver.get();
+        return Push([exec, driver](MYSQL* con) { exec(con, driver); }, config);
+    }
+
+    ~DBPool()
+    {
+        while (m_queue_size > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(64));
+        }
+
+        m_exit = true;
+        for (auto& worker : m_worker_vect)
+        {
+            std::lock_guard<std::mutex> lk(worker->m_mut);
+            worker->m_notified = true;
+            worker->m_cond.notify_all();
+        }
+
+        for (auto& t : m_db_thread)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        m_db_thread.clear();
+    }
+
+    // 连接由这个驱动创建
+    DBDriver* Driver() const { return m_driver.get(); }
+
+private:
+    bool Push(const std::function<void(MYSQL*)>& exec, const DBConfig& config)
     {
         static thread_local std::map<std::string, std::shared_ptr<DBConfig>> config_table;
         auto iter = config_table.find(config.m_conf_name);
@@ -117,127 +437,301 @@ public:
             iter->second = std::make_shared<DBConfig>(config);
         }
 
-        std::lock_guard<std::mutex> lk(m_queue_mut);
-        m_request_queue.emplace(iter->second, exec);
         m_queue_size++;
-        m_cond.notify_all();
+        Enqueue(DBRequest(iter->second, exec));
         return true;
     }
 
-    ~DBPool()
+    void Enqueue(DBRequest&& req)
     {
-        while (m_queue_size > 0)
+        size_t index = Pick();
+        auto& worker = *m_worker_vect[index];
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(64));
+            std::lock_guard<std::mutex> lk(worker.m_mut);
+            worker.m_queue.push_back(std::move(req));
+            worker.m_size++;
         }
+        Wake(index);
+    }
 
-        m_exit = true;
-        m_cond.notify_all();
-        for (auto& t : m_db_thread)
+    // 优先选择空闲线程, 否则选择队列最短的线程
+    size_t Pick()
+    {
+        size_t start = m_next++;
+        size_t shortest = start % m_worker_vect.size();
+        for (size_t i = 0; i < m_worker_vect.size(); i++)
         {
-            if (t.joinable())
+            size_t index = (start + i) % m_worker_vect.size();
+            auto& worker = *m_worker_vect[index];
+            if (worker.m_idle && worker.m_size == 0)
             {
-                t.join();
+                return index;
+            }
+
+            if (worker.m_size < m_worker_vect[shortest]->m_size)
+            {
+                shortest = index;
             }
         }
-        m_db_thread.clear();
+        return shortest;
     }
 
-private:
-    void SetOptions(MYSQL* con)
+    // 只唤醒目标线程, 目标线程忙时唤醒一个空闲线程来窃取
+    void Wake(size_t index)
     {
-        mysql_options(con, MYSQL_SET_CHARSET_NAME, "utf8");
-        mysql_options(con, MYSQL_INIT_COMMAND, "SET NAMES utf8");
-        mysql_options(con, MYSQL_OPT_CONNECT_TIMEOUT, &m_connect_timeout);
-        mysql_options(con, MYSQL_OPT_RECONNECT, &m_reconnect);
-        mysql_options(con, MYSQL_OPT_COMPRESS, nullptr);
+        if (Notify(index))
+        {
+            return;
+        }
+
+        for (size_t i = 1; i < m_worker_vect.size(); i++)
+        {
+            if (Notify((index + i) % m_worker_vect.size()))
+            {
+                return;
+            }
+        }
     }
 
-    void Thread()
+    bool Notify(size_t index)
     {
+        auto& worker = *m_worker_vect[index];
+        if (!worker.m_idle)
+        {
+            return false;
+        }
 
-        std::map<std::string, SQLConnect> db_table;
-        MYSQL* con = nullptr;
-        DBRequest req;
-        while (!m_exit)
+        std::lock_guard<std::mutex> lk(worker.m_mut);
+        worker.m_notified = true;
+        worker.m_cond.notify_one();
+        return true;
+    }
+
+    bool PopLocal(DBWorker& worker, DBRequest& req)
+    {
+        if (worker.m_size == 0)
         {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lk(worker.m_mut);
+        if (worker.m_queue.empty())
+        {
+            return false;
+        }
+        req = std::move(worker.m_queue.front());
+        worker.m_queue.pop_front();
+        worker.m_size--;
+        return true;
+    }
+
+    bool Steal(size_t self, DBRequest& req)
+    {
+        for (size_t i = 1; i < m_worker_vect.size(); i++)
+        {
+            auto& worker = *m_worker_vect[(self + i) % m_worker_vect.size()];
+            if (worker.m_size == 0)
             {
-                std::unique_lock<std::mutex> lk(m_queue_mut);
-                m_cond.wait_for(lk, std::chrono::seconds(2), [&] { return m_exit || !m_request_queue.empty(); });
-                if (m_exit)
-                {
-                    break;
-                }
+                continue;
+            }
 
-                if (m_request_queue.empty())
-                {
-                    lk.unlock();
-                    for (auto iter = db_table.begin(); iter != db_table.end(); iter++)
-                    {
-                        if (!iter->second.IsVaild())
-                        {
-                            iter = db_table.erase(iter);
-                            continue;
-                        }
-                        iter->second.TestConnect();
-                    }
-                    for (auto& db : db_table)
-                    {
-                        db.second.TestConnect();
-                    }
-                    continue;
-                }
+            std::lock_guard<std::mutex> lk(worker.m_mut);
+            if (worker.m_queue.empty())
+            {
+                continue;
+            }
+            req = std::move(worker.m_queue.back());
+            worker.m_queue.pop_back();
+            worker.m_size--;
+            return true;
+        }
+        return false;
+    }
+
+    bool HasRequest()
+    {
+        for (auto& worker : m_worker_vect)
+        {
+            if (worker->m_size > 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 没有请求时等待, 超时返回 false; 有请求在等待连接时缩短等待时间, 及时处理等待超时
+    bool Wait(DBWorker& worker)
+    {
+        std::unique_lock<std::mutex> lk(worker.m_mut);
+        worker.m_idle = true;
+        if (HasRequest())
+        {
+            worker.m_idle = false;
+            return true;
+        }
+
+        auto timeout = m_parked > 0 ? std::chrono::milliseconds(m_expire_interval) : std::chrono::milliseconds(2000);
+        bool ret = worker.m_cond.wait_for(lk, timeout, [&] { return m_exit || worker.m_notified; });
+        worker.m_notified = false;
+        worker.m_idle = false;
+        return ret;
+    }
 
-                req = m_request_queue.front();
-                m_request_queue.pop();
-                m_queue_size--;
+    // 配置变化时使用新的连接池, 旧连接池在最后一个请求归还连接后释放, 排队的请求改用新配置重新排队
+    std::shared_ptr<ConnectPool> GetConnectPool(const std::shared_ptr<DBConfig>& config)
+    {
+        std::shared_ptr<ConnectPool> replaced;
+        std::shared_ptr<ConnectPool> ret;
+        {
+            std::lock_guard<std::mutex> lk(m_connect_mut);
+            auto& connect_pool = m_connect_table[config->m_conf_name];
+            if (!connect_pool || !connect_pool->Config()->Equal(*config))
+            {
+                replaced = std::move(connect_pool);
+                connect_pool = std::make_shared<ConnectPool>(config, m_driver.get());
             }
+            ret = connect_pool;
+        }
 
-            auto& db = req.m_db;
-            auto db_iter = db_table.find(db->m_conf_name);
-            if (db_iter == db_table.end())
+        if (replaced)
+        {
+            for (auto& req : replaced->TakeWaiting())
             {
-                if (!(con = Connect(db.get())))
-                {
-                    continue;
-                }
-                db_table[db->m_conf_name].SetConnect(con, db);
+                m_parked--;
+                req.m_db = config;
+                Enqueue(std::move(req));
             }
-            else
+        }
+        return ret;
+    }
+
+    // 把连接池交还的排队请求放回工作线程的队列
+    void Expire()
+    {
+        if (m_parked == 0)
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<ConnectPool>> pool_vect;
+        {
+            std::lock_guard<std::mutex> lk(m_connect_mut);
+            for (auto& connect_pool : m_connect_table)
             {
-                con = db_iter->second.m_con;
+                pool_vect.emplace_back(connect_pool.second);
+            }
+        }
+
+        for (auto& connect_pool : pool_vect)
+        {
+            for (auto& req : connect_pool->Expire())
+            {
+                m_parked--;
+                Enqueue(std::move(req));
             }
-            req.m_func(con);
         }
     }
 
-    MYSQL* Connect(const DBConfig* config)
+    // 最多每2秒检测一次所有连接池
+    void Maintain()
     {
-        MYSQL* con = mysql_init(nullptr);
-        if (!con)
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (now - m_maintain_time < 2)
         {
-            return nullptr;
+            return;
         }
 
-        SetOptions(con);
-        if (!mysql_real_connect(con, config->m_host.c_str(), config->m_user.c_str(), config->m_password.c_str(), config->m_db.c_str(), config->m_port, nullptr, 0))
+        std::unique_lock<std::mutex> maintain_lk(m_maintain_mut, std::try_to_lock);
+        if (!maintain_lk.owns_lock())
         {
-            mysql_close(con);
-            return nullptr;
+            return;
+        }
+        m_maintain_time = now;
+
+        std::vector<std::shared_ptr<ConnectPool>> pool_vect;
+        {
+            std::lock_guard<std::mutex> lk(m_connect_mut);
+            for (auto& connect_pool : m_connect_table)
+            {
+                pool_vect.emplace_back(connect_pool.second);
+            }
+        }
+
+        for (auto& connect_pool : pool_vect)
+        {
+            connect_pool->Maintain();
         }
-        return con;
     }
 
-    std::atomic<bool> m_exit;
-    std::condition_variable m_cond;
-    std::queue<DBRequest> m_request_queue;
+    void Thread(size_t index)
+    {
+        auto& worker = *m_worker_vect[index];
+        DBRequest req;
+        while (!m_exit)
+        {
+            if (!PopLocal(worker, req) && !Steal(index, req))
+            {
+                if (!Wait(worker) && !m_exit)
+                {
+                    Expire();
+                    Maintain();
+                }
+                continue;
+            }
+            m_queue_size--;
+            Execute(req);
+            Expire();
+            Maintain();
+        }
+    }
 
-    int32_t m_connect_timeout = 8;
-    int32_t m_reconnect = 1;
+    // 取不到连接(连接失败或等待超时)时也执行回调, con 为空, 由回调按失败处理
+    // 连接达到上限时请求在连接池排队, 工作线程继续处理其他请求; 归还连接时直接执行排在最前的请求
+    void Execute(DBRequest& req)
+    {
+        auto connect_pool = GetConnectPool(req.m_db);
+        MYSQL* con = req.m_con;
+        if (!req.m_ready)
+        {
+            // 先计数, 请求排队后可能立即被其他线程取走
+            m_queue_size++;
+            m_parked++;
+            if (!connect_pool->Checkout(req, con))
+            {
+                return;
+            }
+            m_queue_size--;
+            m_parked--;
+        }
+
+        while (true)
+        {
+            req.m_func(con);
+            req = DBRequest();
+            if (!con || !connect_pool->Checkin(con, req))
+            {
+                break;
+            }
+            m_queue_size--;
+            m_parked--;
+        }
+    }
+
+    std::atomic<bool> m_exit;
+    std::shared_ptr<DBDriver> m_driver;
 
-    std::mutex m_queue_mut;
+    std::vector<std::unique_ptr<DBWorker>> m_worker_vect;
+    std::atomic<size_t> m_next{0};
+    std::mutex m_connect_mut;
+    std::map<std::string, std::shared_ptr<ConnectPool>> m_connect_table;
+    std::mutex m_maintain_mut;
+    std::atomic<int64_t> m_maintain_time{0};
     std::vector<std::thread> m_db_thread;
     std::atomic_size_t m_queue_size;
+    std::atomic<size_t> m_parked{0};  // 在连接池排队等待连接的请求数
+
+    static constexpr int32_t m_expire_interval = 5;  // 毫秒
 };
 
 #endif  // DB_TEST_POOL_H
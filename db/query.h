@@ -1,29 +1,90 @@
 #ifndef DB_QUERY_H
 #define DB_QUERY_H
 
+#include <algorithm>
 #include <functional>
+#include <memory_resource>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <unistd.h>
 #include <cassert>
 #include "accessor.h"
 #include "adapter.h"
+#include "arena.h"
+#include "cache.h"
+#include "column.h"
 #include "pool.h"
 #include "replace.h"
 #include "row.h"
+#include "schema.h"
+#include "statement.h"
 #include "data_queue.h"
+#include "engine.h"
+#include "flight.h"
+#include "decode.h"
+#include "ring_queue.h"
+#include "task.h"
 #include "event.h"
 #include <sys/eventfd.h>
 
+template <typename STORE>
+struct StoreHolder
+{
+    explicit StoreHolder(std::shared_ptr<std::pmr::memory_resource> resource = nullptr)
+        : m_resource(std::move(resource))
+        , m_arena(m_resource)
+        , m_store(PmrStore<STORE>::Make(m_resource.get()))
+    {
+    }
+
+    // 并行查询时合并进来的分片, 保证其 arena 中的字符串有效
+    std::vector<std::shared_ptr<void>> m_shard_vect;
+    // 设置了 Memory 时 pmr 容器的节点和 arena 都从这里分配, 随 holder 整块释放
+    std::shared_ptr<std::pmr::memory_resource> m_resource;
+    Arena m_arena;
+    STORE m_store;
+};
+
 struct QueryContext
 {
+    // 交出当前的 store, arena 跟随返回的 shared_ptr 释放
+    template <typename Ret>
+    std::shared_ptr<Ret> Take()
+    {
+        auto* store = static_cast<Ret*>(m_store);
+        return std::shared_ptr<Ret>(TakeHolder(), store);
+    }
+
+    std::shared_ptr<void> TakeHolder()
+    {
+        m_store = nullptr;
+        m_arena = nullptr;
+        return std::move(m_holder);
+    }
+
     size_t m_bind_type_code = 0;
     size_t m_obj_type_code = 0;
+    size_t m_schema_type_code = 0;
     void* m_obj = nullptr;
+    // StoreBatch 时解码好的对象先放在这里, 攒够一批再交给 store
+    void* m_batch = nullptr;
     void* m_store = nullptr;
+    Arena* m_arena = nullptr;
+    std::shared_ptr<void> m_holder;
+    // 增量刷新时在这个 store 上继续填充, 不新建
+    std::shared_ptr<void> m_base;
+    // 每个 store 新建一个内存资源
+    std::function<std::shared_ptr<std::pmr::memory_resource>()> m_memory;
     Row m_row;
+    size_t m_row_count = 0;
     std::function<void(void*)> m_clear;
-    std::vector<std::function<void(const char*, void*)>> m_bind_vect;
+    std::vector<std::function<void(QueryContext&, const char*, size_t)>> m_bind_vect;
+    // 预处理语句中直接写入成员的列, 其他列以字符串取回后使用 m_bind_vect 转换
+    std::vector<std::function<void(Statement&, size_t, void*)>> m_stmt_vect;
+    // 绑定的成员追加到 ColumnStore 的对应列
+    std::vector<column_append_t> m_column_vect;
 };
 
 template<typename T>
@@ -63,15 +124,264 @@ struct QueryAsyncContext
 
         if (ctx->m_queue.IsEmpty())
         {
-            delete ctx;
+            // 工作线程可能还持有引用, 由最后一个引用释放
+            auto self = std::move(ctx->m_self);
+            return;
         }
+
+        // 分块结果还没有全部到达
+        event_base_once(ctx->m_base, ctx->m_fd, EV_READ, &QueryAsyncContext::Callback, ctx, nullptr);
     }
 
     int32_t m_fd = -1;
+    event_base* m_base = nullptr;
+    std::shared_ptr<QueryAsyncContext> m_self;
     std::function<void(T&)> m_handler;
     DataQueue<std::shared_ptr<T>> m_queue;
 };
 
+// 并行查询的分片两两合并, 先完成的分片等待下一个, 合并在各工作线程上进行, 最后剩下的一个交给 m_done
+struct QueryMerge
+{
+    void Finish(std::shared_ptr<void> shard)
+    {
+        while (true)
+        {
+            std::shared_ptr<void> other;
+            {
+                std::lock_guard<std::mutex> lk(m_mut);
+                if (m_left <= 1)
+                {
+                    break;
+                }
+
+                if (!m_pending)
+                {
+                    m_pending = std::move(shard);
+                    return;
+                }
+                other = std::move(m_pending);
+                m_left--;
+            }
+
+            if (!shard)
+            {
+                shard = std::move(other);
+            }
+            else if (other)
+            {
+                m_merge(shard, other);
+            }
+        }
+        m_done(std::move(shard));
+    }
+
+    std::mutex m_mut;
+    std::shared_ptr<void> m_pending;
+    size_t m_left = 0;
+    std::function<void(std::shared_ptr<void>&, std::shared_ptr<void>&)> m_merge;
+    std::function<void(std::shared_ptr<void>)> m_done;
+};
+
+// 等待其他查询执行相同 sql 的结果集, 不占用连接和工作线程; 子查询执行完并且所有结果集到达后由最后一方调用 m_finish
+struct FlightWait
+{
+    // 登记一个等待的 sql, 返回它在 m_result_vect 中的下标
+    size_t Add(const std::string& sql)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_result_vect.emplace_back(sql, nullptr);
+        m_left++;
+        return m_result_vect.size() - 1;
+    }
+
+    // 成为执行者时撤销登记, 只有登记的线程调用
+    void Cancel()
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_result_vect.pop_back();
+        m_left--;
+    }
+
+    void Arrive(size_t index, std::shared_ptr<const CacheResult> result)
+    {
+        std::function<void()> finish;
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_result_vect[index].second = std::move(result);
+            if (--m_left > 0)
+            {
+                return;
+            }
+            finish.swap(m_finish);
+        }
+        finish();
+    }
+
+    // 子查询执行完时调用
+    void Settle(std::function<void()> finish)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            if (--m_left > 0)
+            {
+                m_finish = std::move(finish);
+                return;
+            }
+        }
+        finish();
+    }
+
+    std::mutex m_mut;
+    size_t m_left = 1;
+    // sql 和收到的结果集, 执行者失败时结果集为空
+    std::vector<std::pair<std::string, std::shared_ptr<const CacheResult>>> m_result_vect;
+    std::function<void()> m_finish;
+};
+
+// 增量刷新的状态, 同一个 Query 的多次 Run 共享: 已经读到的最大水位和持续 upsert 的 store
+struct QueryDelta
+{
+    using copy_t = std::function<std::shared_ptr<void>(const std::shared_ptr<void>&)>;
+    using wait_t = std::function<void(std::shared_ptr<void>)>;
+
+    // 开始一次刷新, 给出要渲染的水位和要填充的 store(为空时新建), replay 非空时先把它的行写入 store;
+    // 上一次刷新还没有结束时登记 wait 并返回 false
+    bool Begin(std::string& watermark, std::shared_ptr<void>& base, std::shared_ptr<const CacheResult>& replay, const copy_t& copy,
+               wait_t wait)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if (m_running)
+        {
+            m_wait_vect.emplace_back(std::move(wait));
+            return false;
+        }
+        m_running = true;
+
+        // 上次返回的 store 还在被使用时, 优先重用已经没有人使用的上上次的 store, 重放上一次的增量追到最新;
+        // 否则复制一份再更新, 不能复制时全量加载
+        bool busy = m_holder.use_count() > 1;
+        bool spare = busy && m_spare.use_count() == 1 && m_rows;
+        bool full = !m_holder || (m_full_every > 0 && m_count >= m_full_every) || (busy && !spare && !copy);
+        replay = nullptr;
+        if (full)
+        {
+            m_watermark = m_initial;
+            m_count = 0;
+            base = nullptr;
+        }
+        else if (!busy)
+        {
+            m_count++;
+            base = m_holder;
+        }
+        else
+        {
+            m_count++;
+            base = spare ? m_spare : copy(m_holder);
+            replay = spare ? m_rows : nullptr;
+            m_prev = m_holder;
+        }
+        m_holder = nullptr;
+        m_spare = nullptr;
+        m_rows = nullptr;
+        watermark = m_watermark;
+        return true;
+    }
+
+    // 查询失败时不推进水位, 下一次从原来的水位重新读取; rows 为这一次写入 store 的行, 为空表示不能重放
+    void Commit(const std::string& watermark, bool failed, const std::shared_ptr<void>& holder, std::shared_ptr<const CacheResult> rows)
+    {
+        std::vector<wait_t> wait_vect;
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            if (!failed)
+            {
+                m_watermark = watermark;
+            }
+            m_holder = holder;
+            // holder 为上一次返回的 store 加上 rows, 调用方释放上一次的 store 后可以重用它
+            if (!failed && m_prev && rows)
+            {
+                m_spare = std::move(m_prev);
+                m_rows = std::move(rows);
+            }
+            m_prev = nullptr;
+            m_running = false;
+            wait_vect.swap(m_wait_vect);
+        }
+
+        for (auto& wait : wait_vect)
+        {
+            wait(holder);
+        }
+    }
+
+    // 整数按数值比较, 其他(如 datetime)按字符串比较
+    static bool Less(const std::string& a, const char* b, size_t len)
+    {
+        if (a.size() != len && IsNumber(a.data(), a.size()) && IsNumber(b, len))
+        {
+            return a.size() < len;
+        }
+        return a.compare(0, a.size(), b, len) < 0;
+    }
+
+    static bool IsNumber(const char* data, size_t len)
+    {
+        if (len == 0)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            if (data[i] < '0' || data[i] > '9')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 水位直接拼入 sql, 只允许数值和日期时间中出现的字符
+    static bool IsLiteral(const char* data, size_t len)
+    {
+        if (len == 0)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            char c = data[i];
+            if ((c < '0' || c > '9') && c != '-' && c != '+' && c != ':' && c != '.' && c != ' ')
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::mutex m_mut;
+    RowColumn m_column;
+    std::string m_initial;
+    std::string m_watermark;
+    size_t m_full_every = 0;
+    size_t m_count = 0;
+    bool m_running = false;
+    std::shared_ptr<void> m_holder;
+    // 正在进行的刷新开始时返回给调用方的 store
+    std::shared_ptr<void> m_prev;
+    // m_spare 重放 m_rows 后和 m_holder 相同
+    std::shared_ptr<void> m_spare;
+    std::shared_ptr<const CacheResult> m_rows;
+    std::vector<wait_t> m_wait_vect;
+};
+
+#if defined(__cpp_impl_coroutine)
+template <typename Ret, typename POOL>
+struct QueryAwaiter;
+#endif
+
 struct Query
 {
     Query() = default;
@@ -79,6 +389,7 @@ struct Query
     Query& Init(const std::string& sql)
     {
         m_sql = sql;
+        m_template.Parse(m_sql);
         return *this;
     }
 
@@ -90,6 +401,22 @@ struct Query
         std::string query_list;
         Add(query_list, ptr, field, args...);
         Replace::SetData(m_sql, query_list);
+        m_template.Parse(m_sql);
+        return *this;
+    }
+
+    // 使用编译期的 Schema 绑定成员, 需要配合 Store(schema, func)
+    template <typename... FIELD>
+    Query& Init(const std::string& sql, const Schema<FIELD...>& schema)
+    {
+        m_ctx.m_bind_type_code = typeid(typename Schema<FIELD...>::obj_t).hash_code();
+        m_ctx.m_schema_type_code = typeid(Schema<FIELD...>).hash_code();
+        m_sql = sql;
+        std::string query_list;
+        // 预处理语句和列式存储仍然使用逐列的绑定
+        std::apply([&](const FIELD&... field) { (Add(query_list, FIELD::m_ptr, field.m_name), ...); }, schema.m_field_tuple);
+        Replace::SetData(m_sql, query_list);
+        m_template.Parse(m_sql);
         return *this;
     }
 
@@ -107,6 +434,115 @@ struct Query
         return *this;
     }
 
+    // 使用服务端预处理语句和二进制协议, 不支持时退回文本查询
+    Query& Prepare(bool prepare = true)
+    {
+        m_prepare = prepare;
+        return *this;
+    }
+
+    // 参数分批查询: 每个参数按 row_sql 渲染, 每批最多 count 个/max_bytes 字节, 用 , 连接后替换sql模板中的 {batch}
+    Query& Batch(const std::string& row_sql, size_t count, size_t max_bytes = 1 << 20)
+    {
+        m_batch_template.Parse(row_sql);
+        m_batch_count = count;
+        m_batch_bytes = max_bytes;
+        return *this;
+    }
+
+    // 流式读取(mysql_use_result, 预处理语句不调用 mysql_stmt_store_result), chunk_rows > 0 时每满 chunk_rows 行交出一个部分结果
+    Query& Stream(size_t chunk_rows = 0)
+    {
+        m_stream = true;
+        m_chunk_rows = chunk_rows;
+        return *this;
+    }
+
+    template <typename Ret>
+    Query& Stream(size_t chunk_rows, std::function<void(std::shared_ptr<Ret>)> chunk)
+    {
+        Stream(chunk_rows);
+        m_chunk = [chunk](QueryContext& ctx) {
+            chunk(ctx.Take<Ret>());
+        };
+        return *this;
+    }
+
+    // 有参数时每次最多 count 条/max_bytes 字节的 sql 用 ; 连接后一次发送(多语句), 各条的结果集依次处理;
+    // 某条出错时服务端不再执行后面的, 跳过出错的那条后重新发送剩下的; 只在 DBPool 上生效
+    // 多语句模式下参数中的 ; 可以拼出任意语句: WithParam 的字符串参数由驱动转义(模板中要给它加引号), With 自定义渲染的查询不打包
+    Query& Pack(size_t count, size_t max_bytes = 1 << 20)
+    {
+        m_pack_count = count;
+        m_pack_bytes = max_bytes;
+        return *this;
+    }
+
+    // 有参数时 I/O 和解码分成两个阶段: 工作线程发送 sql 并读取完整的结果集, 交给单独的解码线程逐行处理,
+    // 解码第 k 条的结果时已经在等待第 k+1 条; depth 为已读取还没解码的结果集的上限; 只在 DBPool 上生效, 不能和流式读取一起使用
+    Query& Pipeline(size_t depth = 4)
+    {
+        m_pipeline = depth;
+        return *this;
+    }
+
+    // 缓存结果集 ttl_ms 毫秒, key 为 配置名 + 渲染后的 sql, 缓存命中时不访问数据库; 预处理语句和流式读取不使用缓存
+    Query& Cache(int64_t ttl_ms)
+    {
+        m_cache_ttl = ttl_ms;
+        return *this;
+    }
+
+    // 合并相同的查询: 同一时间同一个 Query(及其副本)相同 配置名 + sql + 结果类型 的 Run 只执行一次, 所有等待者拿到同一个 store;
+    // Store 无法比较, 每次新建的 Query 即使 sql 和 Store 都相同, Run 也不合并, 只合并下面的 sql, 需要合并 Run 时用 Coalesce(key)
+    // DBPool 上不同查询中相同的 sql 只执行一次, 等待者不占用连接, 结果集到达后回放, 执行者失败时重新执行; 同一次查询的参数中渲染出相同 sql 的只执行一次
+    Query& Coalesce(bool coalesce = true)
+    {
+        m_coalesce = coalesce;
+        return *this;
+    }
+
+    // 由调用方保证 key 相同的 Query 的 Store 等价, 每次新建的 Query 之间也可以共享 Run 的结果
+    Query& Coalesce(const std::string& key)
+    {
+        m_coalesce = true;
+        m_coalesce_key = key;
+        return *this;
+    }
+
+    // 避免字符串字面量转换为 bool
+    Query& Coalesce(const char* key) { return Coalesce(std::string(key)); }
+
+    // 增量刷新: sql 中的 {watermark} 替换为之前读到的 column 列的最大值(第一次为 initial), 结果 upsert 到上一次返回的 store 中;
+    // column 需要是整数或时间列, full_every > 0 时每 full_every 次增量后全量加载一次, 用于清理已经删除的行
+    // 水位不转义直接拼入 sql, 只接受由数字和 -+:. 空格组成的值(整数、小数、日期时间), 其他值不作为水位
+    Query& Delta(const std::string& column, const std::string& initial = "0", size_t full_every = 0)
+    {
+        m_delta = std::make_shared<QueryDelta>();
+        m_delta->m_column = RowColumn(column);
+        m_delta->m_initial = initial;
+        if (!QueryDelta::IsLiteral(initial.data(), initial.size()))
+        {
+            Log::Warn("watermark is not a number or time: %s", initial.c_str());
+            m_delta->m_initial = "0";
+        }
+        m_delta->m_full_every = full_every;
+        return *this;
+    }
+
+    // store 和 arena 从 pmr 内存资源分配, 随返回的结果一起整块释放; STORE 需要是 std::pmr 容器才能用上
+    Query& Memory(size_t block_size = 64 * 1024)
+    {
+        return Memory([block_size]() { return std::make_shared<std::pmr::monotonic_buffer_resource>(block_size); });
+    }
+
+    // 自定义内存资源, 如需要复用删除节点的 std::pmr::unsynchronized_pool_resource; 并行查询的分片共享一次创建的资源, 加锁分配
+    Query& Memory(std::function<std::shared_ptr<std::pmr::memory_resource>()> resource)
+    {
+        m_ctx.m_memory = std::move(resource);
+        return *this;
+    }
+
     template <typename T>
     Query& Store(T func)
     {
@@ -120,276 +556,1359 @@ struct Query
         m_ctx.m_obj_type_code = typeid(OBJ).hash_code();
         assert(m_ctx.m_bind_type_code == m_ctx.m_obj_type_code && "bind type != store type");
         m_create = [](QueryContext& ctx) {
-            ctx.m_store = new STORE();
-            ctx.m_obj = new OBJ();
+            CreateStore<STORE>(ctx);
+            if (!ctx.m_obj)
+            {
+                ctx.m_obj = new OBJ();
+            }
         };
 
         m_delete = [](QueryContext& ctx) {
             delete static_cast<OBJ*>(ctx.m_obj);
-            delete static_cast<STORE*>(ctx.m_store);
+            ctx.m_obj = nullptr;
+            ctx.Take<STORE>();
         };
 
         m_ctx.m_clear = [](void* obj) { static_cast<OBJ*>(obj)->Clear(); };
 
-        m_fetch = [func](QueryContext& ctx, std::vector<std::string>& field_vect, MYSQL_ROW row) {
-            if (!ctx.m_store && !ctx.m_obj)
+        m_fetch = [func](QueryContext& ctx, MYSQL_ROW row, unsigned long* length) {
+            if (!ctx.m_store || !ctx.m_obj)
             {
                 return;
             }
-            ctx.m_row.m_field_table.clear();
+            ctx.m_row.SetRow(row, length);
             ctx.m_clear(ctx.m_obj);
-            for (size_t i = 0; i < field_vect.size(); i++)
+            size_t size = std::min(ctx.m_bind_vect.size(), ctx.m_row.Size());
+            for (size_t i = 0; i < size; i++)
             {
-                if (i < ctx.m_bind_vect.size() && ctx.m_bind_vect[i])
-                {
-                    ctx.m_bind_vect[i](row[i], ctx.m_obj);
-                }
-                else
+                if (ctx.m_bind_vect[i])
                 {
-                    ctx.m_row.m_field_table[field_vect[i]] = row[i];
+                    ctx.m_bind_vect[i](ctx, row[i], length[i]);
                 }
             }
             func(*static_cast<STORE*>(ctx.m_store), static_cast<OBJ*>(ctx.m_obj), ctx.m_row);
         };
+
+        m_handle = [func](QueryContext& ctx) {
+            func(*static_cast<STORE*>(ctx.m_store), static_cast<OBJ*>(ctx.m_obj), ctx.m_row);
+        };
+        m_flush = nullptr;
+        DefaultMerge<STORE>(std::integral_constant<bool, MergeStore<STORE>::value>());
+        DefaultCopy<STORE>(std::is_copy_constructible<STORE>());
+        m_store_id = NextStoreId();
+        m_schema_mismatch = false;
         return *this;
     }
 
-    template <typename STORE>
-    Query& Store(std::function<void(STORE& store, Row& row)> func)
+    // 文本协议的每一行按 Schema 内联解码, 再直接调用 func; OBJ 和 Schema 的类型不一致时编译失败
+    template <typename... FIELD, typename T>
+    Query& Store(const Schema<FIELD...>& schema, T func)
     {
-        m_create = [](QueryContext& ctx) { ctx.m_store = new STORE(); };
-
-        m_delete = [](QueryContext& ctx) { delete static_cast<STORE*>(ctx.m_store); };
+        return StoreSchema(schema, func, Lambda::LTF(func));
+    }
 
-        m_fetch = [func](QueryContext& ctx, std::vector<std::string>& field_vect, MYSQL_ROW row) {
-            if (ctx.m_store)
+    template <typename... FIELD, typename T, typename STORE, typename OBJ>
+    Query& StoreSchema(const Schema<FIELD...>&, T func, std::function<void(STORE& store, OBJ*, Row& row)> erased)
+    {
+        static_assert(std::is_same<OBJ, typename Schema<FIELD...>::obj_t>::value, "store type != schema type");
+        Store(std::move(erased));
+        // Init 和 Store 是两次调用, 只能在运行时比较; 不一致时 Run 不执行 sql, 直接返回空结果
+        if (m_ctx.m_schema_type_code != typeid(Schema<FIELD...>).hash_code())
+        {
+            Log::Warn("Init and Store use different schemas: %s", m_sql.c_str());
+            m_schema_mismatch = true;
+            return *this;
+        }
+        m_fetch = [func](QueryContext& ctx, MYSQL_ROW row, unsigned long* length) {
+            if (!ctx.m_store || !ctx.m_obj)
             {
                 return;
             }
-            for (size_t i = 0; i < field_vect.size(); i++)
-            {
-                ctx.m_row.m_field_table[field_vect[i]] = row[i];
-            }
-            func(*static_cast<STORE*>(ctx.m_store), ctx.m_row);
+            ctx.m_row.SetRow(row, length);
+            auto* obj = static_cast<OBJ*>(ctx.m_obj);
+            obj->Clear();
+            Schema<FIELD...>::Decode(ctx.m_arena, *obj, row, length, ctx.m_row.Size());
+            func(*static_cast<STORE*>(ctx.m_store), obj, ctx.m_row);
         };
         return *this;
     }
 
-    template <typename T, typename DATA>
-    void Add(std::string& query_list, DATA(T::*ptr), const std::string& field)
+    // 列式存储: Init 中绑定的每个成员成为 ColumnStore<OBJ> 中的一列, 结果类型为 ColumnStore<OBJ>
+    // 列只能追加, 不能和 Delta 一起使用, Run 直接返回空结果
+    template <typename OBJ>
+    Query& StoreColumn()
     {
-        if (!query_list.empty())
-            query_list.append(",");
-        query_list.append(field);
-
-        m_ctx.m_bind_vect.emplace_back([ptr](const char* data_ptr, void* obj) {
-            if (!obj)
-            {
-                return;
-            }
-            auto* data = static_cast<T*>(obj);
-            Convert::ToData(data_ptr, data->*ptr);
-        });
+        auto append_vect = m_ctx.m_column_vect;
+        return Store(std::function<void(ColumnStore<OBJ>&, OBJ*, Row&)>([append_vect](ColumnStore<OBJ>& store, OBJ* obj, Row&) {
+            store.Append(append_vect, obj);
+        }));
     }
 
-    template <typename T>
-    void Add(std::string& query_list, std::string(T::*ptr), const std::string& field)
+    template <typename STORE>
+    Query& Store(std::function<void(STORE& store, Row& row)> func)
     {
-        if (!query_list.empty())
-            query_list.append(",");
-        query_list.append(field);
+        m_create = [](QueryContext& ctx) { CreateStore<STORE>(ctx); };
 
-        m_ctx.m_bind_vect.emplace_back([ptr](const char* data_ptr, void* obj) {
-            if (!obj)
+        m_delete = [](QueryContext& ctx) { ctx.Take<STORE>(); };
+
+        m_fetch = [func](QueryContext& ctx, MYSQL_ROW row, unsigned long* length) {
+            if (!ctx.m_store)
             {
                 return;
             }
-            auto* data = static_cast<T*>(obj);
-            data->*ptr = data_ptr;
-        });
+            ctx.m_row.SetRow(row, length);
+            func(*static_cast<STORE*>(ctx.m_store), ctx.m_row);
+        };
+
+        m_handle = [func](QueryContext& ctx) { func(*static_cast<STORE*>(ctx.m_store), ctx.m_row); };
+        m_flush = nullptr;
+        DefaultMerge<STORE>(std::integral_constant<bool, MergeStore<STORE>::value>());
+        DefaultCopy<STORE>(std::is_copy_constructible<STORE>());
+        m_store_id = NextStoreId();
+        m_schema_mismatch = false;
+        return *this;
     }
 
-    template <typename T, typename DATA, typename... ARGS>
-    void Add(std::string& query_list, DATA(T::*ptr), const std::string& field, ARGS&&... args)
+    // 按批交给 func: 每满 batch_size 个对象调用一次, 查询结束和分块交出前把剩下的交出; func 可以移走 batch 中的对象
+    template <typename T>
+    Query& StoreBatch(size_t batch_size, T func)
     {
-        Add(query_list, ptr, field);
-        Add(query_list, args...);
+        return StoreBatch(batch_size, Lambda::LTF(func));
     }
 
-    void DoQuery(MYSQL* con)
+    template <typename STORE, typename OBJ>
+    Query& StoreBatch(size_t batch_size, std::function<void(STORE& store, std::vector<OBJ>& batch)> func)
     {
-        std::string sql;
-        if (m_accessor)
-        {
-            sql = m_sql;
-            std::string error;
-            MYSQL_ROW row;
-            MYSQL_RES* mysql_res = nullptr;
-
-            m_delete(m_ctx);
-            m_create(m_ctx);
-            std::vector<std::string> field_vect;
-            while (m_accessor->Render(m_sql, sql))
+        m_ctx.m_obj_type_code = typeid(OBJ).hash_code();
+        assert(m_ctx.m_bind_type_code == m_ctx.m_obj_type_code && "bind type != store type");
+        batch_size = std::max<size_t>(batch_size, 1);
+        m_create = [batch_size](QueryContext& ctx) {
+            CreateStore<STORE>(ctx);
+            if (!ctx.m_obj)
             {
-                if (mysql_res)
-                {
-                    mysql_free_result(mysql_res);
-                    mysql_res = nullptr;
-                }
-
-                if (mysql_query(con, sql.c_str()) != 0)
-                {
-                    error = mysql_error(con);
-                    Log::Warn("%s", error.c_str());
-                    continue;
-                }
+                ctx.m_obj = new OBJ();
+            }
+            if (!ctx.m_batch)
+            {
+                auto* batch = new std::vector<OBJ>();
+                batch->reserve(batch_size);
+                ctx.m_batch = batch;
+            }
+        };
 
-                mysql_res = mysql_store_result(con);
-                if (!mysql_res)
-                {
-                    error = mysql_error(con);
-                    Log::Warn("%s", error.c_str());
-                    continue;
-                }
+        m_delete = [](QueryContext& ctx) {
+            delete static_cast<OBJ*>(ctx.m_obj);
+            ctx.m_obj = nullptr;
+            delete static_cast<std::vector<OBJ>*>(ctx.m_batch);
+            ctx.m_batch = nullptr;
+            ctx.Take<STORE>();
+        };
 
-                if (field_vect.empty())
-                {
-                    MYSQL_FIELD* field;
-                    while ((field = mysql_fetch_field(mysql_res)))
-                    {
-                        field_vect.emplace_back(field->name);
-                    }
-                }
+        m_ctx.m_clear = [](void* obj) { static_cast<OBJ*>(obj)->Clear(); };
 
-                while ((row = mysql_fetch_row(mysql_res)))
+        m_fetch = [batch_size, func](QueryContext& ctx, MYSQL_ROW row, unsigned long* length) {
+            if (!ctx.m_store || !ctx.m_obj)
+            {
+                return;
+            }
+            ctx.m_row.SetRow(row, length);
+            ctx.m_clear(ctx.m_obj);
+            size_t size = std::min(ctx.m_bind_vect.size(), ctx.m_row.Size());
+            for (size_t i = 0; i < size; i++)
+            {
+                if (ctx.m_bind_vect[i])
                 {
-                    m_fetch(m_ctx, field_vect, row);
+                    ctx.m_bind_vect[i](ctx, row[i], length[i]);
                 }
             }
+            PushBatch<STORE, OBJ>(ctx, batch_size, func);
+        };
+
+        m_handle = [batch_size, func](QueryContext& ctx) { PushBatch<STORE, OBJ>(ctx, batch_size, func); };
+
+        m_flush = [func](QueryContext& ctx) {
+            auto* batch = static_cast<std::vector<OBJ>*>(ctx.m_batch);
+            if (!ctx.m_store || !batch || batch->empty())
+            {
+                return;
+            }
+            func(*static_cast<STORE*>(ctx.m_store), *batch);
+            batch->clear();
+        };
+        DefaultMerge<STORE>(std::integral_constant<bool, MergeStore<STORE>::value>());
+        DefaultCopy<STORE>(std::is_copy_constructible<STORE>());
+        m_store_id = NextStoreId();
+        m_schema_mismatch = false;
+        return *this;
+    }
+
+    template <typename STORE, typename OBJ>
+    static void PushBatch(QueryContext& ctx, size_t batch_size, const std::function<void(STORE&, std::vector<OBJ>&)>& func)
+    {
+        auto* batch = static_cast<std::vector<OBJ>*>(ctx.m_batch);
+        batch->push_back(std::move(*static_cast<OBJ*>(ctx.m_obj)));
+        if (batch->size() >= batch_size)
+        {
+            func(*static_cast<STORE*>(ctx.m_store), *batch);
+            batch->clear();
+        }
+    }
+
+    // 并行查询时把 src 分片合并到 dst, 需要在 Store 之后调用
+    template <typename T>
+    Query& Merge(T func)
+    {
+        return Merge(Lambda::LTF(func));
+    }
+
+    template <typename STORE>
+    Query& Merge(std::function<void(STORE& dst, STORE& src)> func)
+    {
+        m_merge = [func](std::shared_ptr<void>& dst, std::shared_ptr<void>& src) {
+            auto* dst_holder = static_cast<StoreHolder<STORE>*>(dst.get());
+            auto* src_holder = static_cast<StoreHolder<STORE>*>(src.get());
+            func(dst_holder->m_store, src_holder->m_store);
+            dst_holder->m_shard_vect.emplace_back(std::move(src));
+        };
+        return *this;
+    }
+
+    template <typename STORE>
+    void DefaultMerge(std::true_type)
+    {
+        Merge(std::function<void(STORE&, STORE&)>(&MergeStore<STORE>::Merge));
+    }
+
+    // 没有合并方法的 STORE 不拆分参数
+    template <typename STORE>
+    void DefaultMerge(std::false_type)
+    {
+        m_merge = nullptr;
+    }
+
+    // 复制的 store 中的字符串仍然指向原来的 arena, 只引用其内存块, 不保留原来的 store
+    template <typename STORE>
+    void DefaultCopy(std::true_type)
+    {
+        m_copy = [](QueryContext& ctx, const std::shared_ptr<void>& src) -> std::shared_ptr<void> {
+            auto* src_holder = static_cast<StoreHolder<STORE>*>(src.get());
+            auto holder = std::make_shared<StoreHolder<STORE>>(ctx.m_memory ? ctx.m_memory() : nullptr);
+            holder->m_store = src_holder->m_store;
+            holder->m_arena.Share(src_holder->m_arena);
+            holder->m_shard_vect = src_holder->m_shard_vect;
+            return holder;
+        };
+    }
+
+    template <typename STORE>
+    void DefaultCopy(std::false_type)
+    {
+        m_copy = nullptr;
+    }
+
+    template <typename T, typename DATA>
+    void Add(std::string& query_list, DATA(T::*ptr), const std::string& field)
+    {
+        if (!query_list.empty())
+            query_list.append(",");
+        query_list.append(field);
+
+        m_ctx.m_bind_vect.emplace_back([ptr](QueryContext& ctx, const char* data_ptr, size_t len) {
+            if (!ctx.m_obj)
+            {
+                return;
+            }
+            auto* data = static_cast<T*>(ctx.m_obj);
+            Convert::ToData(data_ptr, len, data->*ptr);
+        });
+        AddStmt(ptr, std::integral_constant<bool, StmtType<DATA>::m_direct>());
+        m_ctx.m_column_vect.emplace_back(MakeColumnAppend(ptr));
+    }
+
+    // 字符串拷贝到 store 的 arena 中, 和返回的 store 生命周期相同
+    template <typename T>
+    void Add(std::string& query_list, std::string_view(T::*ptr), const std::string& field)
+    {
+        if (!query_list.empty())
+            query_list.append(",");
+        query_list.append(field);
+
+        m_ctx.m_bind_vect.emplace_back([ptr](QueryContext& ctx, const char* data_ptr, size_t len) {
+            if (!ctx.m_obj || !ctx.m_arena)
+            {
+                return;
+            }
+            auto* data = static_cast<T*>(ctx.m_obj);
+            data->*ptr = data_ptr ? ctx.m_arena->Copy(data_ptr, len) : std::string_view();
+        });
+        AddStmt(ptr, std::false_type());
+        m_ctx.m_column_vect.emplace_back(MakeColumnAppend(ptr));
+    }
+
+    template <typename T, typename DATA, typename... ARGS>
+    void Add(std::string& query_list, DATA(T::*ptr), const std::string& field, ARGS&&... args)
+    {
+        Add(query_list, ptr, field);
+        Add(query_list, args...);
+    }
+
+    // 数值成员直接作为结果缓冲区
+    template <typename T, typename DATA>
+    void AddStmt(DATA(T::*ptr), std::true_type)
+    {
+        m_ctx.m_stmt_vect.emplace_back([ptr](Statement& stmt, size_t i, void* obj) {
+            if (!obj)
+            {
+                stmt.BindBuffer(i);
+                return;
+            }
+            stmt.BindData(i, static_cast<T*>(obj)->*ptr);
+        });
+    }
+
+    template <typename T, typename DATA>
+    void AddStmt(DATA(T::*), std::false_type)
+    {
+        m_ctx.m_stmt_vect.emplace_back(nullptr);
+    }
+
+    template <typename STORE>
+    static void CreateStore(QueryContext& ctx)
+    {
+        if (ctx.m_store)
+        {
+            return;
+        }
+        if (ctx.m_base)
+        {
+            auto* holder = static_cast<StoreHolder<STORE>*>(ctx.m_base.get());
+            ctx.m_store = &holder->m_store;
+            ctx.m_arena = &holder->m_arena;
+            ctx.m_holder = ctx.m_base;
+            return;
+        }
+        auto holder = std::make_shared<StoreHolder<STORE>>(ctx.m_memory ? ctx.m_memory() : nullptr);
+        ctx.m_store = &holder->m_store;
+        ctx.m_arena = &holder->m_arena;
+        ctx.m_holder = holder;
+    }
+
+    // 语句按连接缓存, 同一个连接上相同的 sql 只 prepare 一次; 出错的语句丢弃, 下次重新 prepare
+    bool DoPrepareQuery(MYSQL* con)
+    {
+        std::string sql;
+        std::vector<size_t> slot_vect;
+        if (!m_handle || !m_template.Prepare(sql, slot_vect) || (!slot_vect.empty() && (!m_accessor || !m_accessor->CanBind(m_template))))
+        {
+            return false;
+        }
+
+        std::string error;
+        Statement* stmt = StatementCache::Instance().Get(con, sql, error);
+        if (!stmt)
+        {
+            Log::Warn("%s", error.c_str());
+            return false;
+        }
+
+        m_delete(m_ctx);
+        m_create(m_ctx);
+        // 对象按二进制绑定, 行不能重放
+        m_delta_record = false;
+        auto& field_vect = stmt->Field();
+        m_ctx.m_row.SetField(&field_vect);
+        std::vector<char*> cell_vect(field_vect.size(), nullptr);
+        std::vector<unsigned long> length_vect(field_vect.size(), 0);
+        for (size_t i = 0; i < field_vect.size(); i++)
+        {
+            if (i < m_ctx.m_stmt_vect.size() && m_ctx.m_stmt_vect[i])
+            {
+                m_ctx.m_stmt_vect[i](*stmt, i, m_ctx.m_obj);
+            }
+            else
+            {
+                stmt->BindBuffer(i);
+            }
+        }
+
+        if (!stmt->BindResult())
+        {
+            Log::Warn("%s", stmt->Error());
+            m_failed = true;
+            StatementCache::Instance().Erase(con, sql);
+            return true;
+        }
+
+        bool broken = false;
+        std::vector<MYSQL_BIND> param_vect;
+        auto execute = [&]() {
+            // 流式读取时结果集不在客户端缓存
+            if (!stmt->Execute(param_vect, !m_stream))
+            {
+                Log::Warn("%s", stmt->Error());
+                m_failed = true;
+                broken = true;
+                return;
+            }
+
+            while (true)
+            {
+                if (m_ctx.m_obj)
+                {
+                    m_ctx.m_clear(m_ctx.m_obj);
+                }
+
+                int32_t ret = stmt->Fetch();
+                if (ret <= 0)
+                {
+                    if (ret < 0)
+                    {
+                        Log::Warn("%s", stmt->Error());
+                        m_failed = true;
+                        broken = true;
+                    }
+                    break;
+                }
+
+                for (size_t i = 0; i < field_vect.size(); i++)
+                {
+                    if (i < m_ctx.m_stmt_vect.size() && m_ctx.m_stmt_vect[i])
+                    {
+                        continue;
+                    }
+
+                    size_t len = 0;
+                    cell_vect[i] = const_cast<char*>(stmt->Data(i, len));
+                    length_vect[i] = len;
+                    if (i < m_ctx.m_bind_vect.size() && m_ctx.m_bind_vect[i])
+                    {
+                        m_ctx.m_bind_vect[i](m_ctx, cell_vect[i], len);
+                    }
+                }
+                m_ctx.m_row.SetRow(cell_vect.data(), length_vect.data());
+                m_handle(m_ctx);
+                Fetched();
+            }
+            stmt->FreeResult();
+        };
+
+        if (m_accessor)
+        {
+            while (m_accessor->Bind(m_template, slot_vect, param_vect))
+            {
+                execute();
+            }
         }
         else
         {
-            std::string error;
-            MYSQL_ROW row;
-            MYSQL_RES* mysql_res = nullptr;
+            execute();
+        }
 
-            m_delete(m_ctx);
-            m_create(m_ctx);
+        if (broken)
+        {
+            StatementCache::Instance().Erase(con, sql);
+        }
+        return true;
+    }
+
+    // 执行一条sql, 结果逐行交给 m_fetch; 其他查询正在执行相同的 sql 时登记等待, 结果集到达后在 Settle 中回放
+    bool Execute(MYSQL* con, const std::string& sql, std::vector<std::string>& field_vect)
+    {
+        if (FromCache(sql, field_vect))
+        {
+            if (m_flight_leader)
+            {
+                // 取连接之前成为执行者, 等待者重新执行时会命中缓存
+                m_flight_leader = false;
+                SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Done(m_conf_name + '\0' + sql, nullptr);
+            }
+            return true;
+        }
+
+        if (m_coalesce)
+        {
+            if (m_flight_leader)
+            {
+                // 取连接之前已经成为执行者
+                m_flight_leader = false;
+            }
+            else if (Follow(sql))
+            {
+                return true;
+            }
+            m_last_result.reset();
+        }
+
+        bool ret = RealQuery(con, sql, field_vect);
+        if (m_coalesce)
+        {
+            SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Done(m_conf_name + '\0' + sql, m_last_result);
+            m_last_result.reset();
+        }
+        return ret;
+    }
+
+    // 其他查询正在执行相同的 sql 时登记等待并返回 true; 返回 false 表示成为执行者, 执行完要调用 Done
+    bool Follow(const std::string& sql)
+    {
+        if (!m_flight_wait)
+        {
+            m_flight_wait = std::make_shared<FlightWait>();
+        }
+        auto wait = m_flight_wait;
+        size_t index = wait->Add(sql);
+        bool leader = SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Join(m_conf_name + '\0' + sql, [wait, index](const std::shared_ptr<const CacheResult>& result) {
+            wait->Arrive(index, result);
+        });
+        if (leader)
+        {
+            wait->Cancel();
+        }
+        return !leader;
+    }
+
+    // 子查询执行完后调用: 等待的结果集全部到达后按顺序回放, 执行者失败的 sql 重新取连接执行, 最后调用 finish
+    static void Settle(DBPool& pool, std::shared_ptr<Query> query, const DBConfig& config, std::function<void()> finish)
+    {
+        auto wait = std::move(query->m_flight_wait);
+        if (!wait)
+        {
+            finish();
+            return;
+        }
+
+        DBPool* pool_ptr = &pool;
+        wait->Settle([pool_ptr, query, wait, config, finish]() {
+            std::vector<std::string> retry_vect;
             std::vector<std::string> field_vect;
-            if (mysql_query(con, m_sql.c_str()) != 0)
+            for (auto& result : wait->m_result_vect)
             {
-                error = mysql_error(con);
-                Log::Warn("%s", error.c_str());
-                return;
+                if (result.second)
+                {
+                    query->Replay(*result.second, field_vect);
+                }
+                else
+                {
+                    retry_vect.emplace_back(std::move(result.first));
+                }
             }
 
-            mysql_res = mysql_store_result(con);
-            if (!mysql_res)
+            if (retry_vect.empty())
             {
-                error = mysql_error(con);
-                Log::Warn("%s", error.c_str());
+                finish();
                 return;
             }
 
-            if (field_vect.empty())
+            auto func = [pool_ptr, query, retry_vect, config, finish](MYSQL* con, DBDriver* driver) {
+                query->m_driver = driver;
+                if (!con)
+                {
+                    Log::Warn("no connection for %s", query->m_conf_name.c_str());
+                    query->m_failed = true;
+                }
+                std::vector<std::string> field_vect;
+                for (size_t i = 0; con && i < retry_vect.size(); i++)
+                {
+                    if (!query->Execute(con, retry_vect[i], field_vect))
+                    {
+                        query->m_failed = true;
+                    }
+                }
+                Settle(*pool_ptr, query, config, finish);
+            };
+            pool_ptr->Add(func, config);
+        });
+    }
+
+    bool RealQuery(MYSQL* con, const std::string& sql, std::vector<std::string>& field_vect)
+    {
+        if (m_driver->Query(con, sql) != 0)
+        {
+            Log::Warn("%s", m_driver->Error(con));
+            return false;
+        }
+
+        // 流式读取时不在客户端缓存整个结果集
+        MYSQL_RES* mysql_res = m_stream ? m_driver->UseResult(con) : m_driver->StoreResult(con);
+        if (!mysql_res)
+        {
+            Log::Warn("%s", m_driver->Error(con));
+            return false;
+        }
+
+        bool ret = Consume(con, mysql_res, sql, field_vect);
+        m_driver->FreeResult(mysql_res);
+        return ret;
+    }
+
+    // 连续的 sql 打包发送, 缓存命中的不发送; 打包时不等待其他线程上相同的 sql
+    // 字符串参数由驱动转义后再渲染, 不能转义的访问器不打包
+    bool DoPackQuery(MYSQL* con)
+    {
+        if (!m_accessor->CanEscape())
+        {
+            return false;
+        }
+
+        if (m_driver->SetServerOption(con, MYSQL_OPTION_MULTI_STATEMENTS_ON) != 0)
+        {
+            Log::Warn("%s", m_driver->Error(con));
+            return false;
+        }
+
+        DBDriver* driver = m_driver;
+        m_accessor->m_escape = [driver, con](std::string& out, const char* data, size_t len) { driver->Escape(con, out, data, len); };
+
+        m_delete(m_ctx);
+        m_create(m_ctx);
+        std::vector<std::string> field_vect;
+        std::vector<std::string> sql_vect;
+        std::string sql;
+        size_t index = 0;
+        bool more = true;
+        while (true)
+        {
+            size_t bytes = 0;
+            for (auto& pending : sql_vect)
+            {
+                bytes += pending.size() + 1;
+            }
+
+            while (more && sql_vect.size() < m_pack_count && bytes < m_pack_bytes)
             {
-                MYSQL_FIELD* field;
-                while ((field = mysql_fetch_field(mysql_res)))
+                if (!NextSql(sql, index++))
                 {
-                    field_vect.emplace_back(field->name);
+                    more = false;
+                    break;
                 }
+                if (FromCache(sql, field_vect))
+                {
+                    continue;
+                }
+                bytes += sql.size() + 1;
+                sql_vect.emplace_back(std::move(sql));
             }
 
-            while ((row = mysql_fetch_row(mysql_res)))
+            if (sql_vect.empty())
             {
-                m_fetch(m_ctx, field_vect, row);
+                break;
             }
-            mysql_free_result(mysql_res);
+            size_t count = ExecutePack(con, sql_vect, field_vect);
+            sql_vect.erase(sql_vect.begin(), sql_vect.begin() + count);
         }
+
+        // 连接归还给连接池, 恢复为单语句
+        m_driver->SetServerOption(con, MYSQL_OPTION_MULTI_STATEMENTS_OFF);
+        m_accessor->m_escape = nullptr;
+        return true;
     }
 
-    template <typename Ret>
-    void Run(int32_t parallel, DBPool& pool, const DBConfig& config, DataQueue<std::shared_ptr<Ret>>& data_queue)
+    // 工作线程只访问连接和参数, 结果集交给共享的 DecodePool 按顺序解码, 解码只访问 m_ctx 和结果集
+    // 缓存命中的结果集同样交给解码, 等待其他查询的结果集在 Settle 中回放; 解码失败和查询失败一样标记 m_failed
+    bool DoPipelineQuery(MYSQL* con)
     {
-        if (m_accessor)
+        struct Stage
+        {
+            MYSQL_RES* m_res = nullptr;
+            std::shared_ptr<const CacheResult> m_cache;
+            std::string m_sql;
+            // 非空时这个结果集由本查询执行, 解码完要通知等待者
+            std::string m_flight_key;
+        };
+
+        m_delete(m_ctx);
+        m_create(m_ctx);
+        std::vector<std::string> field_vect;
+        DecodeStrand<Stage> strand(m_pipeline, [this, con, &field_vect](Stage& stage) {
+            if (stage.m_cache)
+            {
+                Replay(*stage.m_cache, field_vect);
+                return true;
+            }
+            bool ret = Consume(con, stage.m_res, stage.m_sql, field_vect);
+            m_driver->FreeResult(stage.m_res);
+            if (!stage.m_flight_key.empty())
+            {
+                SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Done(stage.m_flight_key, ret ? m_last_result : nullptr);
+            }
+            m_last_result.reset();
+            return ret;
+        });
+
+        std::string sql;
+        for (size_t i = 0; NextSql(sql, i); i++)
         {
-            auto accessor_vect = m_accessor->MakeSubAccessor(parallel);
-            std::vector<std::shared_ptr<Query>> query_vect;
-            std::vector<std::function<void(MYSQL*)>> func_vect;
-            for (auto& accessor : accessor_vect)
+            Stage stage;
+            if (m_cache_ttl > 0)
             {
-                auto sub_query = std::make_shared<Query>(*this);
-                sub_query->m_accessor = accessor;
-                query_vect.emplace_back(sub_query);
-                func_vect.emplace_back(std::bind(&Query::DoQuery, sub_query.get(), std::placeholders::_1));
+                stage.m_cache = ResultCache::Instance().Get(m_conf_name, sql);
             }
-            
-            for (auto& func : func_vect)
+            if (!stage.m_cache && m_coalesce)
             {
-                pool.Add(func, config);
+                if (Follow(sql))
+                {
+                    continue;
+                }
+                stage.m_flight_key = m_conf_name + '\0' + sql;
+            }
+            if (!stage.m_cache)
+            {
+                if (m_driver->Query(con, sql) != 0 || !(stage.m_res = m_driver->StoreResult(con)))
+                {
+                    Log::Warn("%s", m_driver->Error(con));
+                    m_failed = true;
+                    if (!stage.m_flight_key.empty())
+                    {
+                        SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Done(stage.m_flight_key, nullptr);
+                    }
+                    continue;
+                }
             }
+            stage.m_sql = sql;
+            strand.Push(std::move(stage));
         }
-        else
+
+        if (strand.Wait())
         {
-            auto query = std::make_shared<Query>(*this);
-            data_queue.SetMax(1);
-            auto func = [query, &data_queue](MYSQL* con) {
-                query->DoQuery(con);
-                data_queue.Push(std::shared_ptr<Ret>(static_cast<Ret*>(query->m_ctx.m_store)));
-                query->m_ctx.m_store = nullptr;
+            m_failed = true;
+        }
+        return true;
+    }
+
+    // 返回处理完的条数: 第 i 条出错时返回 i + 1, 后面的没有执行; 连接断开时全部放弃
+    size_t ExecutePack(MYSQL* con, const std::vector<std::string>& sql_vect, std::vector<std::string>& field_vect)
+    {
+        std::string packed;
+        for (auto& sql : sql_vect)
+        {
+            if (!packed.empty())
+            {
+                packed.push_back(';');
+            }
+            packed.append(sql);
+        }
+
+        if (m_driver->Query(con, packed) != 0)
+        {
+            Log::Warn("%s", m_driver->Error(con));
+            m_failed = true;
+            return Broken(con) ? sql_vect.size() : 1;
+        }
+
+        size_t i = 0;
+        while (true)
+        {
+            MYSQL_RES* mysql_res = m_stream ? m_driver->UseResult(con) : m_driver->StoreResult(con);
+            if (mysql_res)
+            {
+                if (!Consume(con, mysql_res, sql_vect[i], field_vect))
+                {
+                    m_failed = true;
+                }
+                m_driver->FreeResult(mysql_res);
+            }
+            else if (m_driver->FieldCount(con) != 0)
+            {
+                Log::Warn("%s", m_driver->Error(con));
+                m_failed = true;
+            }
+            i++;
+
+            int32_t status = m_driver->NextResult(con);
+            if (status < 0)
+            {
+                return sql_vect.size();
+            }
+            if (status > 0)
+            {
+                Log::Warn("%s", m_driver->Error(con));
+                m_failed = true;
+                return Broken(con) ? sql_vect.size() : std::min(i + 1, sql_vect.size());
+            }
+        }
+    }
+
+    bool Broken(MYSQL* con)
+    {
+        uint32_t err = m_driver->Errno(con);
+        return err == 2006 || err == 2013;
+    }
+
+    // 结果集逐行交给 m_fetch, 第一个结果集确定列名
+    bool Consume(MYSQL* con, MYSQL_RES* mysql_res, const std::string& sql, std::vector<std::string>& field_vect)
+    {
+        std::shared_ptr<CacheResult> cache;
+        if (m_cache_ttl > 0 || m_coalesce)
+        {
+            std::vector<std::string> name_vect;
+            m_driver->FieldName(mysql_res, name_vect);
+            if (field_vect.empty())
+            {
+                field_vect = name_vect;
+                m_ctx.m_row.SetField(&field_vect);
+            }
+            cache = std::make_shared<CacheResult>(std::move(name_vect));
+        }
+        else if (field_vect.empty())
+        {
+            m_driver->FieldName(mysql_res, field_vect);
+            m_ctx.m_row.SetField(&field_vect);
+        }
+
+        MYSQL_ROW row;
+        while ((row = m_driver->FetchRow(mysql_res)))
+        {
+            unsigned long* length = m_driver->FetchLengths(mysql_res);
+            if (cache)
+            {
+                cache->AddRow(row, length);
+            }
+            m_fetch(m_ctx, row, length);
+            Fetched();
+        }
+
+        bool ret = !m_stream || m_driver->Errno(con) == 0;
+        if (!ret)
+        {
+            Log::Warn("%s", m_driver->Error(con));
+        }
+        else if (cache)
+        {
+            cache->Finish();
+            m_last_result = cache;
+            if (m_cache_ttl > 0)
+            {
+                ResultCache::Instance().Put(m_conf_name, sql, std::move(cache), m_cache_ttl);
+            }
+        }
+        return ret;
+    }
+
+    bool FromCache(const std::string& sql, std::vector<std::string>& field_vect)
+    {
+        if (m_cache_ttl <= 0)
+        {
+            return false;
+        }
+
+        // 调用线程上已经查找过一次
+        if (m_cache_checked)
+        {
+            m_cache_checked = false;
+            return false;
+        }
+
+        auto cache = ResultCache::Instance().Get(m_conf_name, sql);
+        if (!cache)
+        {
+            return false;
+        }
+        Replay(*cache, field_vect);
+        return true;
+    }
+
+    void Replay(const CacheResult& cache, std::vector<std::string>& field_vect)
+    {
+        if (field_vect.empty())
+        {
+            field_vect = cache.m_field_vect;
+            m_ctx.m_row.SetField(&field_vect);
+        }
+
+        for (size_t i = 0; i < cache.RowCount(); i++)
+        {
+            m_fetch(m_ctx, cache.Row(i), cache.Length(i));
+            Fetched();
+        }
+    }
+
+    // 在调用线程上把上上次的 store 追到上一次, 之后才开始记录这一次的行
+    void ReplayDelta(const CacheResult& rows)
+    {
+        std::vector<std::string> field_vect;
+        m_create(m_ctx);
+        Replay(rows, field_vect);
+        if (m_flush)
+        {
+            m_flush(m_ctx);
+        }
+        m_ctx.m_row = Row();
+    }
+
+    // 没有参数的查询命中缓存时直接在调用线程上处理, 不经过连接池
+    bool DoCacheQuery()
+    {
+        if (m_cache_ttl <= 0 || m_accessor)
+        {
+            return false;
+        }
+
+        m_delete(m_ctx);
+        m_create(m_ctx);
+        std::vector<std::string> field_vect;
+        if (FromCache(m_sql, field_vect))
+        {
+            return true;
+        }
+        m_cache_checked = true;
+        return false;
+    }
+
+    // 依次给出要执行的 sql, 没有参数时只有 m_sql 一条
+    bool NextSql(std::string& sql, size_t index)
+    {
+        if (!m_accessor)
+        {
+            if (index > 0)
+            {
+                return false;
+            }
+            sql = m_sql;
+            return true;
+        }
+
+        if (m_batch_count > 0)
+        {
+            return m_accessor->RenderBatch(m_template, m_batch_template, m_batch_count, m_batch_bytes, sql);
+        }
+        return m_accessor->RenderUnique(m_template, sql);
+    }
+
+    // 达到分块行数时交出当前的 store, 并新建一个继续填充
+    void Fetched()
+    {
+        if (m_delta_record)
+        {
+            if (!m_delta_rows)
+            {
+                m_delta_rows = std::make_shared<CacheResult>(m_ctx.m_row.Field());
+            }
+            m_delta_rows->AddRow(m_ctx.m_row.RawRow(), m_ctx.m_row.RawLength());
+        }
+        if (m_delta)
+        {
+            size_t index = m_ctx.m_row.Index(m_delta->m_column);
+            const char* data = m_ctx.m_row.Data(index);
+            if (data && QueryDelta::Less(m_watermark, data, m_ctx.m_row.Length(index)))
+            {
+                if (QueryDelta::IsLiteral(data, m_ctx.m_row.Length(index)))
+                {
+                    m_watermark.assign(data, m_ctx.m_row.Length(index));
+                }
+                else
+                {
+                    Log::Warn("watermark is not a number or time: %s", std::string(data, m_ctx.m_row.Length(index)).c_str());
+                }
+            }
+        }
+
+        if (m_chunk_rows == 0 || ++m_ctx.m_row_count < m_chunk_rows || !m_chunk)
+        {
+            return;
+        }
+
+        m_ctx.m_row_count = 0;
+        if (m_flush)
+        {
+            m_flush(m_ctx);
+        }
+        m_chunk(m_ctx);
+        m_create(m_ctx);
+    }
+
+    void DoQuery(MYSQL* con)
+    {
+        if (!con)
+        {
+            Log::Warn("no connection for %s", m_conf_name.c_str());
+            m_failed = true;
+            m_delete(m_ctx);
+            m_create(m_ctx);
+            if (m_flight_leader)
+            {
+                m_flight_leader = false;
+                SingleFlight<std::shared_ptr<const CacheResult>>::Instance().Done(m_conf_name + '\0' + m_sql, nullptr);
+            }
+            return;
+        }
+
+        if (m_prepare && !m_batch_count && m_cache_ttl <= 0 && !m_coalesce && m_driver->CanPrepare() && DoPrepareQuery(con))
+        {
+            return;
+        }
+
+        if (m_pack_count > 1 && m_accessor && DoPackQuery(con))
+        {
+            return;
+        }
+
+        if (m_pipeline > 0 && m_accessor && !m_stream && DoPipelineQuery(con))
+        {
+            return;
+        }
+
+        m_delete(m_ctx);
+        m_create(m_ctx);
+        std::vector<std::string> field_vect;
+        std::string sql;
+        for (size_t i = 0; NextSql(sql, i); i++)
+        {
+            if (!Execute(con, sql, field_vect))
+            {
+                m_failed = true;
+            }
+        }
+    }
+
+    // 没有参数的查询在取连接之前加入合并, 等待者不进入连接池
+    static void Dispatch(DBPool& pool, std::shared_ptr<Query> query, const DBConfig& config, std::function<void()> finish)
+    {
+        if (query->m_coalesce && !query->m_accessor)
+        {
+            if (query->Follow(query->m_sql))
+            {
                 query->m_delete(query->m_ctx);
-            };
-            pool.Add(func, config);
+                query->m_create(query->m_ctx);
+                Settle(pool, query, config, finish);
+                return;
+            }
+            query->m_flight_leader = true;
         }
+
+        DBPool* pool_ptr = &pool;
+        auto func = [pool_ptr, query, config, finish](MYSQL* con, DBDriver* driver) {
+            query->m_driver = driver;
+            query->DoQuery(con);
+            Settle(*pool_ptr, query, config, finish);
+        };
+        pool.Add(func, config);
     }
 
-    template <typename Ret>
-    void Run(int32_t parallel, DBPool& pool, const DBConfig& config, event_base* ebase, std::function<void(Ret&)> handler)
+#if defined(MYSQL_WAIT_READ)
+    // 非阻塞引擎只支持文本查询, 结果集总是完整读取到客户端; Prepare、Stream、Pack 和 Pipeline 被忽略, query 是 Submit 建立的副本
+    static void Dispatch(DBEngine& engine, std::shared_ptr<Query> query, const DBConfig& config, std::function<void()> finish)
     {
-        if (m_accessor)
+        query->m_prepare = false;
+        query->m_stream = false;
+        query->m_pack_count = 0;
+        query->m_pipeline = 0;
+
+        auto field_vect = std::make_shared<std::vector<std::string>>();
+        auto index = std::make_shared<size_t>(0);
+        // 已经发出但还没有收到结果集的 sql, 引擎出错时不会回调 m_result
+        auto waiting = std::make_shared<bool>(false);
+        query->m_driver = MySqlDriver::Instance().get();
+        query->m_delete(query->m_ctx);
+        query->m_create(query->m_ctx);
+
+        EngineRequest req;
+        req.m_next = [query, index, field_vect, waiting](std::string& sql) {
+            query->m_failed = query->m_failed || *waiting;
+            *waiting = false;
+            while (query->NextSql(sql, (*index)++))
+            {
+                if (!query->FromCache(sql, *field_vect))
+                {
+                    *waiting = true;
+                    return true;
+                }
+            }
+            return false;
+        };
+        req.m_result = [query, field_vect, waiting](MYSQL* con, MYSQL_RES* mysql_res, const std::string& sql) {
+            *waiting = false;
+            if (!query->Consume(con, mysql_res, sql, *field_vect))
+            {
+                query->m_failed = true;
+            }
+        };
+        req.m_done = [query, waiting, finish](bool failed) {
+            query->m_failed = query->m_failed || *waiting || failed;
+            finish();
+        };
+        engine.Add(std::move(req), config);
+    }
+#endif
+
+    // 有参数时拆成 parallel 个子查询, 各自填充一个 store 分片, 全部完成后合并为一个结果交给 done
+    template <typename Ret, typename POOL>
+    void Submit(int32_t parallel, POOL& pool, const DBConfig& config, std::function<void(std::shared_ptr<Ret>)> chunk,
+                std::function<void(std::shared_ptr<Ret>)> done)
+    {
+        if (m_schema_mismatch)
+        {
+            done(nullptr);
+            return;
+        }
+
+        if (m_delta && IsColumnStore<Ret>::value)
         {
-            auto accessor_vect = m_accessor->MakeSubAccessor(parallel);
-            std::vector<std::shared_ptr<Query>> query_vect;
-            std::vector<std::function<void(MYSQL*)>> func_vect;
-            for (auto& accessor : accessor_vect)
+            Log::Warn("Delta does not support StoreColumn: %s", m_sql.c_str());
+            done(nullptr);
+            return;
+        }
+
+        // 上一次增量刷新还没有结束时等待它的结果
+        std::string watermark;
+        std::shared_ptr<void> base;
+        std::shared_ptr<const CacheResult> replay;
+        QueryDelta::copy_t copy;
+        if (m_copy)
+        {
+            copy = [this](const std::shared_ptr<void>& src) { return m_copy(m_ctx, src); };
+        }
+        if (m_delta && !m_delta->Begin(watermark, base, replay, copy, [done](std::shared_ptr<void> holder) { done(FromHolder<Ret>(std::move(holder))); }))
+        {
+            return;
+        }
+
+        // 相同的查询正在执行时只登记等待, 分块返回的查询不合并
+        if (m_coalesce && !m_delta && !m_accessor && m_chunk_rows == 0)
+        {
+            using flight_t = SingleFlight<std::shared_ptr<void>>;
+            // Store 不同的 Query 即使 sql 和结果类型相同也不能共享结果
+            std::string key = config.m_conf_name + '\0' + m_sql + '\0' + typeid(Ret).name() + '\0'
+                              + (m_coalesce_key.empty() ? std::to_string(m_store_id) : '\0' + m_coalesce_key);
+            if (!flight_t::Instance().Join(key, [done](const std::shared_ptr<void>& data) { done(std::static_pointer_cast<Ret>(data)); }))
             {
-                auto sub_query = std::make_shared<Query>(*this);
-                sub_query->m_accessor = accessor;
-                query_vect.emplace_back(sub_query);
-                func_vect.emplace_back(std::bind(&Query::DoQuery, sub_query.get(), std::placeholders::_1));
+                return;
             }
+            done = [key, done](std::shared_ptr<Ret> data) {
+                flight_t::Instance().Done(key, data);
+                done(std::move(data));
+            };
+        }
 
-            for (auto& func : func_vect)
+        std::vector<std::shared_ptr<Accessor>> accessor_vect;
+        if (m_accessor)
+        {
+            // 增量刷新只有一个 store, 不拆分参数
+            accessor_vect = m_accessor->MakeSubAccessor(m_merge && !m_delta ? std::max(parallel, 1) : 1);
+            if (m_coalesce)
             {
-                pool.Add(func, config);
+                auto filter = std::make_shared<SqlFilter>();
+                for (auto& accessor : accessor_vect)
+                {
+                    accessor->m_filter = filter;
+                }
             }
         }
         else
         {
-            auto* async_ctx = new QueryAsyncContext<Ret>();
-            async_ctx->m_handler = handler;
+            accessor_vect.emplace_back(nullptr);
+        }
 
+        // 并行查询的分片共享一个内存资源, 合并时直接移动节点, 不再逐个复制到另一个资源; 分块返回的 store 各自释放, 不共享
+        auto memory = m_ctx.m_memory;
+        if (memory && accessor_vect.size() > 1 && m_chunk_rows == 0)
+        {
+            std::shared_ptr<std::pmr::memory_resource> resource = std::make_shared<LockedResource>(memory());
+            memory = [resource]() { return resource; };
+        }
+
+        auto merge = std::make_shared<QueryMerge>();
+        merge->m_left = accessor_vect.size();
+        merge->m_merge = m_merge;
+        merge->m_done = [done](std::shared_ptr<void> holder) { done(FromHolder<Ret>(std::move(holder))); };
+
+        for (auto& accessor : accessor_vect)
+        {
             auto query = std::make_shared<Query>(*this);
-            auto func = [query, async_ctx](MYSQL* con) {
-                query->DoQuery(con);
-                async_ctx->m_queue.Push(std::shared_ptr<Ret>(static_cast<Ret*>(query->m_ctx.m_store)));
-                query->m_ctx.m_store = nullptr;
+            query->m_accessor = accessor;
+            query->m_ctx.m_memory = memory;
+            query->m_conf_name = config.m_conf_name;
+            // 流式读取不在客户端保存完整的结果集, 不使用缓存
+            if (query->m_stream)
+            {
+                query->m_cache_ttl = 0;
+            }
+            if (m_chunk_rows > 0 && !query->m_chunk && chunk)
+            {
+                query->m_chunk = [chunk](QueryContext& ctx) {
+                    chunk(ctx.Take<Ret>());
+                };
+            }
+
+            // 增量刷新不分块返回
+            if (m_delta)
+            {
+                Replace::SetData(query->m_sql, "watermark", watermark);
+                query->m_template.Parse(query->m_sql);
+                query->m_watermark = watermark;
+                query->m_ctx.m_base = base;
+                query->m_chunk = nullptr;
+                if (replay)
+                {
+                    query->ReplayDelta(*replay);
+                }
+                query->m_delta_record = base != nullptr;
+            }
+
+            auto finish = [query, merge]() {
+                if (query->m_flush)
+                {
+                    query->m_flush(query->m_ctx);
+                }
+                auto shard = query->m_ctx.TakeHolder();
                 query->m_delete(query->m_ctx);
-                int64_t data = 1;
-                write(async_ctx->m_fd, &data, sizeof(data));
+                if (query->m_delta)
+                {
+                    query->m_ctx.m_base = nullptr;
+                    std::shared_ptr<CacheResult> rows;
+                    if (query->m_delta_record)
+                    {
+                        rows = query->m_delta_rows ? std::move(query->m_delta_rows) : std::make_shared<CacheResult>(std::vector<std::string>());
+                        rows->Finish();
+                    }
+                    query->m_delta->Commit(query->m_watermark, query->m_failed, shard, std::move(rows));
+                }
+                merge->Finish(std::move(shard));
             };
-
-            event_base_once(ebase, async_ctx->m_fd, EV_READ, &QueryAsyncContext<Ret>::Callback, async_ctx, nullptr);
-            pool.Add(func, config);
+            if (query->DoCacheQuery())
+            {
+                finish();
+                continue;
+            }
+            Dispatch(pool, query, config, finish);
         }
     }
 
+    static uint64_t NextStoreId()
+    {
+        static std::atomic<uint64_t> store_id(0);
+        return ++store_id;
+    }
+
+    template <typename Ret>
+    static std::shared_ptr<Ret> FromHolder(std::shared_ptr<void> holder)
+    {
+        auto* store = holder ? &static_cast<StoreHolder<Ret>*>(holder.get())->m_store : nullptr;
+        return std::shared_ptr<Ret>(std::move(holder), store);
+    }
+
+    // QUEUE 可以是 DataQueue 或 RingQueue, POOL 可以是 DBPool 或 DBEngine
+    template <typename Ret, template <typename> class QUEUE, typename POOL>
+    void Run(int32_t parallel, POOL& pool, const DBConfig& config, QUEUE<std::shared_ptr<Ret>>& data_queue)
+    {
+        data_queue.SetMax(1);
+        Submit<Ret>(
+            parallel, pool, config, [&data_queue](std::shared_ptr<Ret> data) { data_queue.Append(data); },
+            [&data_queue](std::shared_ptr<Ret> data) { data_queue.Push(data); });
+    }
+
+    template <typename Ret, typename POOL>
+    void Run(int32_t parallel, POOL& pool, const DBConfig& config, event_base* ebase, std::function<void(Ret&)> handler)
+    {
+        auto async_ctx = std::make_shared<QueryAsyncContext<Ret>>();
+        async_ctx->m_self = async_ctx;
+        async_ctx->m_handler = handler;
+        async_ctx->m_base = ebase;
+        async_ctx->m_queue.SetMax(1);
+
+        auto notify = [async_ctx]() {
+            int64_t data = 1;
+            write(async_ctx->m_fd, &data, sizeof(data));
+        };
+        event_base_once(ebase, async_ctx->m_fd, EV_READ, &QueryAsyncContext<Ret>::Callback, async_ctx.get(), nullptr);
+        Submit<Ret>(
+            parallel, pool, config,
+            [async_ctx, notify](std::shared_ptr<Ret> data) {
+                async_ctx->m_queue.Append(data);
+                notify();
+            },
+            [async_ctx, notify](std::shared_ptr<Ret> data) {
+                async_ctx->m_queue.Push(data);
+                notify();
+            });
+    }
+
+#if defined(__cpp_impl_coroutine)
+    // co_await 查询结果, 结果到达后在 executor 上恢复
+    template <typename Ret, typename POOL>
+    Task<std::shared_ptr<Ret>> Async(int32_t parallel, POOL& pool, const DBConfig& config, Executor& executor)
+    {
+        return MakeTask(QueryAwaiter<Ret, POOL>{std::make_shared<Query>(*this), parallel, &pool, config, &executor});
+    }
+#endif
+
     std::string m_sql;
+    SqlTemplate m_template;
     QueryContext m_ctx;
     std::shared_ptr<Accessor> m_accessor;
-    std::function<void(QueryContext&, std::vector<std::string>&, MYSQL_ROW)> m_fetch;
+    bool m_prepare = false;
+    bool m_stream = false;
+    size_t m_chunk_rows = 0;
+    std::function<void(QueryContext&)> m_chunk;
+    SqlTemplate m_batch_template;
+    size_t m_batch_count = 0;
+    size_t m_batch_bytes = 0;
+    size_t m_pack_count = 0;
+    size_t m_pack_bytes = 0;
+    size_t m_pipeline = 0;
+    // 执行时所在 DBPool 的驱动, 引擎总是使用 MySqlDriver
+    DBDriver* m_driver = MySqlDriver::Instance().get();
+    std::function<void(QueryContext&, MYSQL_ROW, unsigned long*)> m_fetch;
+    std::function<void(QueryContext&)> m_handle;
+    // StoreBatch 时交出还没有满一批的对象
+    std::function<void(QueryContext&)> m_flush;
     std::function<void(QueryContext&)> m_create;
     std::function<void(QueryContext&)> m_delete;
+    std::function<void(std::shared_ptr<void>&, std::shared_ptr<void>&)> m_merge;
+    std::string m_conf_name;
+    int64_t m_cache_ttl = 0;
+    bool m_cache_checked = false;
+    bool m_coalesce = false;
+    // 每次 Store 分配一个, 副本相同
+    uint64_t m_store_id = 0;
+    std::string m_coalesce_key;
+    std::shared_ptr<const CacheResult> m_last_result;
+    // 取连接之前已经成为 m_sql 的执行者
+    bool m_flight_leader = false;
+    std::shared_ptr<FlightWait> m_flight_wait;
+    std::shared_ptr<QueryDelta> m_delta;
+    // 增量刷新这一次写入 store 的行, 下一次用来把上上次的 store 追到最新
+    bool m_delta_record = false;
+    std::shared_ptr<CacheResult> m_delta_rows;
+    std::function<std::shared_ptr<void>(QueryContext&, const std::shared_ptr<void>&)> m_copy;
+    std::string m_watermark;
+    bool m_failed = false;
+    // Store(schema) 和 Init(schema) 的 Schema 不一致
+    bool m_schema_mismatch = false;
+};
+
+#if defined(__cpp_impl_coroutine)
+template <typename Ret, typename POOL>
+struct QueryAwaiter
+{
+    struct State
+    {
+        std::shared_ptr<Ret> m_data;
+    };
+
+    bool await_ready() const { return false; }
+
+    // 提交之后协程可能已经在其他线程恢复, 不能再访问 this
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        auto query = m_query;
+        auto state = m_state;
+        auto* executor = m_executor;
+        executor->Expect();
+        query->Submit<Ret>(m_parallel, *m_pool, m_config, nullptr, [handle, state, executor](std::shared_ptr<Ret> data) {
+            state->m_data = std::move(data);
+            executor->Post([handle]() { handle.resume(); });
+        });
+    }
+
+    std::shared_ptr<Ret> await_resume() { return std::move(m_state->m_data); }
+
+    std::shared_ptr<Query> m_query;
+    int32_t m_parallel = 1;
+    POOL* m_pool = nullptr;
+    DBConfig m_config;
+    Executor* m_executor = nullptr;
+    std::shared_ptr<State> m_state = std::make_shared<State>();
 };
+#endif
 
 #endif  // DB_QUERY_H
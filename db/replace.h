@@ -1,7 +1,10 @@
 #ifndef DB_TEST_REPLACE_H
 #define DB_TEST_REPLACE_H
 
+#include <atomic>
+#include <charconv>
 #include <string>
+#include <vector>
 
 struct Replace
 {
@@ -31,29 +34,241 @@ struct Replace
     template <typename DATA>
     static void GetData(std::string& str_data, const DATA& data)
     {
-        str_data = std::to_string(data);
+        str_data.clear();
+        Append(str_data, data);
+    }
+
+    static void Append(std::string& out, const std::string& data) { out.append(data); }
+
+    static void Append(std::string& out, const char* data) { out.append(data); }
+
+    static void Append(std::string& out, bool data) { out.push_back(data ? '1' : '0'); }
+
+    template <typename DATA>
+    static void Append(std::string& out, const DATA& data)
+    {
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), data);
+        out.append(buf, res.ptr);
+    }
+
+    // 查找 {id}, 不构造临时字符串
+    static size_t FindVar(const std::string& base, const std::string& id, size_t pos)
+    {
+        size_t next = base.find('{', pos);
+        while (next != std::string::npos)
+        {
+            size_t end = next + 1 + id.size();
+            if (end < base.size() && base[end] == '}' && base.compare(next + 1, id.size(), id) == 0)
+            {
+                return next;
+            }
+            next = base.find('{', next + 1);
+        }
+        return std::string::npos;
     }
 
     template <typename DATA>
     static void SetDataImpl(std::string& tmp, const std::string& base, const std::string& id, const DATA& data)
     {
+        size_t next = FindVar(base, id, 0);
+        if (next == std::string::npos)
+        {
+            if (&tmp != &base)
+            {
+                tmp = base;
+            }
+            return;
+        }
+
         std::string retval;
+        retval.reserve(base.size() + 16);
         size_t last = 0;
-        std::string var_id = "{" + id + "}";
-        size_t var_id_size = var_id.size();
-        size_t next = base.find(var_id, 0);
-        std::string str_data;
-        GetData(str_data, data);
+        size_t var_id_size = id.size() + 2;
         while (next != std::string::npos)
         {
             retval.append(base, last, next - last);
-            retval.append(str_data);
+            Append(retval, data);
             last = next + var_id_size;
-            next = base.find(var_id, next + var_id_size);
+            next = FindVar(base, id, last);
         }
-        retval.append(base, last, next);
-        tmp = retval;
+        retval.append(base, last, std::string::npos);
+        tmp.swap(retval);
     }
 };
 
+// 预编译的sql模板: Init时解析一次 {参数名}, 渲染时按段写入复用的缓冲区
+struct SqlTemplate
+{
+    struct Segment
+    {
+        size_t m_offset = 0;
+        size_t m_size = 0;
+        int32_t m_slot = -1;  // < 0 为普通文本, 否则为参数下标
+    };
+
+    void Parse(const std::string& sql)
+    {
+        static std::atomic<uint64_t> id_seq(0);
+        m_id = ++id_seq;
+        m_sql = sql;
+        m_segment_vect.clear();
+        m_slot_vect.clear();
+
+        size_t last = 0;
+        size_t begin = sql.find('{');
+        while (begin != std::string::npos)
+        {
+            size_t end = sql.find('}', begin + 1);
+            if (end == std::string::npos)
+            {
+                break;
+            }
+
+            // {{name} 这种情况以最近的 { 为准
+            size_t inner = sql.rfind('{', end);
+            if (inner > begin)
+            {
+                begin = inner;
+            }
+
+            AddText(last, begin);
+            Segment seg;
+            seg.m_offset = begin;
+            seg.m_size = end + 1 - begin;
+            seg.m_slot = AddSlot(sql.substr(begin + 1, end - begin - 1));
+            m_segment_vect.emplace_back(seg);
+
+            last = end + 1;
+            begin = sql.find('{', last);
+        }
+        AddText(last, sql.size());
+    }
+
+    // writer(out, slot) 返回 false 时原样保留 {参数名}
+    template <typename WRITER>
+    void Render(std::string& out, WRITER&& writer) const
+    {
+        out.clear();
+        for (auto& seg : m_segment_vect)
+        {
+            if (seg.m_slot < 0 || !writer(out, static_cast<size_t>(seg.m_slot)))
+            {
+                out.append(m_sql, seg.m_offset, seg.m_size);
+            }
+        }
+    }
+
+    // 生成预处理语句: 参数替换为 ?, 并去掉参数两侧的引号, slot_vect 为每个 ? 对应的参数下标
+    // 参数只是字符串字面量的一部分(如 like '%{name}%')时不能替换为 ?, 返回 false, 由调用方退回文本查询
+    bool Prepare(std::string& out, std::vector<size_t>& slot_vect) const
+    {
+        out.clear();
+        slot_vect.clear();
+        char quote = 0;
+        size_t quote_pos = 0;
+        bool skip_quote = false;
+        for (size_t i = 0; i < m_segment_vect.size(); i++)
+        {
+            auto& seg = m_segment_vect[i];
+            if (seg.m_slot < 0)
+            {
+                size_t offset = seg.m_offset;
+                size_t size = seg.m_size;
+                if (skip_quote)
+                {
+                    offset++;
+                    size--;
+                }
+                skip_quote = false;
+                // 记录字符串字面量的开始位置, 字面量中的 \ 转义下一个字符, 连续两个引号在这里相当于结束后又开始
+                for (size_t k = offset; k < offset + size; k++)
+                {
+                    char c = m_sql[k];
+                    if (quote && c == '\\')
+                    {
+                        k++;
+                    }
+                    else if (quote && c == quote)
+                    {
+                        quote = 0;
+                    }
+                    else if (!quote && (c == '\'' || c == '"'))
+                    {
+                        quote = c;
+                        quote_pos = out.size() + k - offset;
+                    }
+                }
+                out.append(m_sql, offset, size);
+                continue;
+            }
+
+            if (quote)
+            {
+                // 只有整个字面量就是这个参数('{name}')时才能去掉引号
+                bool close = i + 1 < m_segment_vect.size() && m_segment_vect[i + 1].m_slot < 0 && m_sql[m_segment_vect[i + 1].m_offset] == quote;
+                if (quote_pos + 1 != out.size() || !close)
+                {
+                    return false;
+                }
+                out.pop_back();
+                quote = 0;
+                skip_quote = true;
+            }
+            out.push_back('?');
+            slot_vect.emplace_back(seg.m_slot);
+        }
+        return true;
+    }
+
+    int32_t FindSlot(const std::string& name) const
+    {
+        for (size_t i = 0; i < m_slot_vect.size(); i++)
+        {
+            if (m_slot_vect[i] == name)
+            {
+                return static_cast<int32_t>(i);
+            }
+        }
+        return -1;
+    }
+
+    const std::string& SlotName(size_t slot) const { return m_slot_vect[slot]; }
+
+    size_t SlotCount() const { return m_slot_vect.size(); }
+
+    const std::string& Source() const { return m_sql; }
+
+    uint64_t Id() const { return m_id; }
+
+private:
+    void AddText(size_t begin, size_t end)
+    {
+        if (end <= begin)
+        {
+            return;
+        }
+        Segment seg;
+        seg.m_offset = begin;
+        seg.m_size = end - begin;
+        m_segment_vect.emplace_back(seg);
+    }
+
+    int32_t AddSlot(const std::string& name)
+    {
+        int32_t slot = FindSlot(name);
+        if (slot >= 0)
+        {
+            return slot;
+        }
+        m_slot_vect.emplace_back(name);
+        return static_cast<int32_t>(m_slot_vect.size() - 1);
+    }
+
+    uint64_t m_id = 0;
+    std::string m_sql;
+    std::vector<Segment> m_segment_vect;
+    std::vector<std::string> m_slot_vect;
+};
+
 #endif  // DB_TEST_REPLACE_H
@@ -0,0 +1,266 @@
+#ifndef _RING_QUEUE_H
+#define _RING_QUEUE_H
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <climits>
+#include <vector>
+
+// 有界无锁 MPMC 队列, 接口与 DataQueue 相同, 只有队列为空/满时才通过 futex 等待
+template <typename T>
+class RingQueue
+{
+public:
+    explicit RingQueue(size_t capacity = 1024)
+        : m_pop_left(0)
+        , m_res_count(0)
+        , m_max(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        m_mask = size - 1;
+        m_cell_vect = std::vector<Cell>(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            m_cell_vect[i].m_seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    bool Pop(T& data, bool is_sync = true)
+    {
+        while (true)
+        {
+            if (TryPop(data))
+            {
+                return true;
+            }
+
+            if (IsEmpty() || !is_sync)
+            {
+                return false;
+            }
+
+            uint32_t seq = m_push_seq.load();
+            m_pop_waiter++;
+            if (TryPop(data))
+            {
+                m_pop_waiter--;
+                return true;
+            }
+
+            if (IsEmpty())
+            {
+                m_pop_waiter--;
+                return false;
+            }
+            FutexWait(m_push_seq, seq);
+            m_pop_waiter--;
+        }
+    }
+
+    // 至少等到一个结果, 然后尽量多取, 返回取到的个数
+    size_t PopBatch(std::vector<T>& data, size_t max, bool is_sync = true)
+    {
+        data.clear();
+        T item;
+        if (max == 0 || !Pop(item, is_sync))
+        {
+            return 0;
+        }
+
+        data.emplace_back(std::move(item));
+        while (data.size() < max && TryPop(item))
+        {
+            data.emplace_back(std::move(item));
+        }
+        return data.size();
+    }
+
+    void Push(const T& res)
+    {
+        Enqueue(res);
+        Notify(m_res_count.fetch_sub(1) <= 1);
+    }
+
+    void PushBatch(const std::vector<T>& res_vect)
+    {
+        if (res_vect.empty())
+        {
+            return;
+        }
+
+        for (auto& res : res_vect)
+        {
+            Enqueue(res);
+        }
+        int64_t count = static_cast<int64_t>(res_vect.size());
+        Notify(m_res_count.fetch_sub(count) <= count);
+    }
+
+    // 追加一个部分结果, 不计入 SetMax 设置的结果数
+    void Append(const T& res)
+    {
+        Enqueue(res);
+        m_pop_left++;
+        Notify(false);
+    }
+
+    bool IsEmpty() const { return m_res_count <= 0 && Size() == 0; }
+
+    size_t Size() const
+    {
+        size_t dequeue_pos = m_dequeue_pos.load();
+        return m_enqueue_pos.load() - dequeue_pos;
+    }
+
+    void SetMax(int64_t max)
+    {
+        m_max = max;
+        m_res_count = max;
+        m_pop_left = max;
+    }
+
+    void SetEmpty()
+    {
+        T item;
+        while (TryPop(item))
+        {
+        }
+        m_res_count = 0;
+        m_pop_left = 0;
+        Notify(true);
+    }
+
+private:
+    struct alignas(64) Cell
+    {
+        std::atomic<size_t> m_seq;
+        T m_data;
+    };
+
+    bool TryPop(T& data)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = m_cell_vect[pos & m_mask];
+            size_t seq = cell.m_seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    data = std::move(cell.m_data);
+                    cell.m_data = T();
+                    cell.m_seq.store(pos + m_mask + 1, std::memory_order_release);
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        m_pop_left--;
+        m_pop_seq++;
+        if (m_push_waiter.load() > 0)
+        {
+            FutexWake(m_pop_seq, 1);
+        }
+        return true;
+    }
+
+    bool TryPush(const T& data)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = m_cell_vect[pos & m_mask];
+            size_t seq = cell.m_seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.m_data = data;
+                    cell.m_seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 队列满时等待消费者取走数据
+    void Enqueue(const T& data)
+    {
+        while (!TryPush(data))
+        {
+            uint32_t seq = m_pop_seq.load();
+            m_push_waiter++;
+            if (TryPush(data))
+            {
+                m_push_waiter--;
+                return;
+            }
+            FutexWait(m_pop_seq, seq);
+            m_push_waiter--;
+        }
+    }
+
+    void Notify(bool all)
+    {
+        m_push_seq++;
+        if (m_pop_waiter.load() > 0)
+        {
+            FutexWake(m_push_seq, all ? INT_MAX : 1);
+        }
+    }
+
+    static void FutexWait(std::atomic<uint32_t>& addr, uint32_t value)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&addr), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+    }
+
+    static void FutexWake(std::atomic<uint32_t>& addr, int32_t count)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+
+    std::vector<Cell> m_cell_vect;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+    alignas(64) std::atomic<uint32_t> m_push_seq{0};
+    std::atomic<int32_t> m_pop_waiter{0};
+    alignas(64) std::atomic<uint32_t> m_pop_seq{0};
+    std::atomic<int32_t> m_push_waiter{0};
+    std::atomic<int64_t> m_pop_left;
+    std::atomic<int64_t> m_res_count;
+    int64_t m_max;
+};
+
+#endif  // _RING_QUEUE_H
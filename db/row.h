@@ -1,24 +1,123 @@
 #ifndef _DB_ROW_H
 #define _DB_ROW_H
 
-#include <map>
+#include <atomic>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "convert.h"
 
+// 列句柄: 第一次使用时解析列下标, 结果集不变时直接按下标读取
+struct RowColumn
+{
+    explicit RowColumn(std::string name = "")
+        : m_name(std::move(name))
+    {
+    }
+
+    std::string m_name;
+    mutable size_t m_index = static_cast<size_t>(-1);
+    mutable uint64_t m_schema = 0;
+};
+
 struct Row
 {
+    static const size_t npos = static_cast<size_t>(-1);
+
+    // 每个结果集调用一次
+    void SetField(const std::vector<std::string>* field_vect)
+    {
+        static std::atomic<uint64_t> schema_seq(0);
+        m_schema = ++schema_seq;
+        m_field_vect = field_vect;
+        m_index_table.clear();
+        for (size_t i = 0; i < field_vect->size(); i++)
+        {
+            m_index_table.emplace((*field_vect)[i], i);
+        }
+    }
+
+    // 每行调用一次, 只保存指针
+    void SetRow(char** row, const unsigned long* length)
+    {
+        m_row = row;
+        m_length = length;
+    }
+
+    size_t Index(const std::string& key) const
+    {
+        auto iter = m_index_table.find(key);
+        return iter == m_index_table.end() ? npos : iter->second;
+    }
+
+    RowColumn Column(const std::string& key) const
+    {
+        RowColumn column(key);
+        Resolve(column);
+        return column;
+    }
+
+    // 列不存在、为 NULL 或转换失败时返回 false; NULL 时 value 为默认值, 需要区分 NULL 时使用 std::optional
     template <typename T>
-    bool Get(const std::string& key, T& value)
+    bool Get(size_t index, T& value) const
     {
-        auto iter = m_field_table.find(key);
-        if (iter == m_field_table.end())
+        if (!m_row || index >= Size())
         {
             return false;
         }
-        Convert::ToData(iter->second, value);
-        return true;
+        const char* ptr = m_row[index];
+        return Convert::ToData(ptr, m_length ? m_length[index] : (ptr ? strlen(ptr) : 0), value);
     }
-    std::map<std::string, const char*> m_field_table;
+
+    template <typename T>
+    bool Get(const RowColumn& column, T& value) const
+    {
+        Resolve(column);
+        return Get(column.m_index, value);
+    }
+
+    template <typename T>
+    bool Get(const std::string& key, T& value) const
+    {
+        return Get(Index(key), value);
+    }
+
+    size_t Index(const RowColumn& column) const
+    {
+        Resolve(column);
+        return column.m_index;
+    }
+
+    const char* Data(size_t index) const { return m_row && index < Size() ? m_row[index] : nullptr; }
+
+    size_t Length(size_t index) const { return m_length && index < Size() ? m_length[index] : 0; }
+
+    size_t Size() const { return m_field_vect ? m_field_vect->size() : 0; }
+
+    const std::string& Name(size_t index) const { return (*m_field_vect)[index]; }
+
+    const std::vector<std::string>& Field() const { return *m_field_vect; }
+
+    // SetRow 传入的原始指针
+    char** RawRow() const { return m_row; }
+
+    const unsigned long* RawLength() const { return m_length; }
+
+private:
+    void Resolve(const RowColumn& column) const
+    {
+        if (column.m_schema != m_schema)
+        {
+            column.m_index = Index(column.m_name);
+            column.m_schema = m_schema;
+        }
+    }
+
+    uint64_t m_schema = 0;
+    char** m_row = nullptr;
+    const unsigned long* m_length = nullptr;
+    const std::vector<std::string>* m_field_vect = nullptr;
+    std::unordered_map<std::string, size_t> m_index_table;
 };
 
 #endif  // SEARCH_SRV_ROW_H
@@ -0,0 +1,84 @@
+#ifndef _DB_SCHEMA_H
+#define _DB_SCHEMA_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "arena.h"
+#include "convert.h"
+
+template <typename T>
+struct MemberTraits;
+
+template <typename OBJ, typename DATA>
+struct MemberTraits<DATA(OBJ::*)>
+{
+    using obj_t = OBJ;
+    using data_t = DATA;
+};
+
+// 编译期绑定的列: 成员指针是模板参数, 列名在运行时给出
+template <auto PTR>
+struct Field
+{
+    static_assert(std::is_member_object_pointer<decltype(PTR)>::value, "Field needs a data member pointer");
+    using obj_t = typename MemberTraits<decltype(PTR)>::obj_t;
+    using data_t = typename MemberTraits<decltype(PTR)>::data_t;
+    static constexpr auto m_ptr = PTR;
+
+    explicit Field(std::string name)
+        : m_name(std::move(name))
+    {
+    }
+
+    static void Decode(Arena* arena, obj_t& obj, const char* data, size_t len)
+    {
+        Decode(arena, obj, data, len, std::is_same<data_t, std::string_view>());
+    }
+
+    // 字符串拷贝到 store 的 arena 中
+    static void Decode(Arena* arena, obj_t& obj, const char* data, size_t len, std::true_type)
+    {
+        obj.*PTR = data && arena ? arena->Copy(data, len) : std::string_view();
+    }
+
+    static void Decode(Arena*, obj_t& obj, const char* data, size_t len, std::false_type)
+    {
+        Convert::ToData(data, len, obj.*PTR);
+    }
+
+    std::string m_name;
+};
+
+// 一组 Field, 所有成员属于同一个 OBJ; 解码一行时按列展开, 没有逐列的间接调用
+template <typename... FIELD>
+struct Schema
+{
+    static_assert(sizeof...(FIELD) > 0, "empty schema");
+    using obj_t = typename std::tuple_element_t<0, std::tuple<FIELD...>>::obj_t;
+    static_assert((std::is_same<typename FIELD::obj_t, obj_t>::value && ...), "all fields of a schema must belong to the same type");
+
+    explicit Schema(FIELD... field)
+        : m_field_tuple(std::move(field)...)
+    {
+    }
+
+    // size 为结果集的列数, 多出的 Field 不解码
+    static void Decode(Arena* arena, obj_t& obj, MYSQL_ROW row, const unsigned long* length, size_t size)
+    {
+        Decode(arena, obj, row, length, size, std::index_sequence_for<FIELD...>());
+    }
+
+    template <size_t... I>
+    static void Decode(Arena* arena, obj_t& obj, MYSQL_ROW row, const unsigned long* length, size_t size, std::index_sequence<I...>)
+    {
+        ((I < size ? FIELD::Decode(arena, obj, row[I], length[I]) : void()), ...);
+    }
+
+    std::tuple<FIELD...> m_field_tuple;
+};
+
+#endif  // _DB_SCHEMA_H
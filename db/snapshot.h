@@ -0,0 +1,282 @@
+#ifndef _DB_SNAPSHOT_H
+#define _DB_SNAPSHOT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "query.h"
+
+// 读线程的编号, 第一次读取时分配, 线程退出时归还; 编号用完后的线程共用一个计数
+struct ReaderId
+{
+    static constexpr size_t m_max = 256;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    static size_t Get()
+    {
+        thread_local ReaderId id;
+        return id.m_index;
+    }
+
+    ReaderId()
+    {
+        for (size_t i = 0; i < m_max; i++)
+        {
+            bool used = false;
+            if (Used()[i].compare_exchange_strong(used, true))
+            {
+                m_index = i;
+                return;
+            }
+        }
+    }
+
+    ~ReaderId()
+    {
+        if (m_index != npos)
+        {
+            Used()[m_index].store(false);
+        }
+    }
+
+    static std::atomic<bool>* Used()
+    {
+        static std::atomic<bool> used[m_max];
+        return used;
+    }
+
+    size_t m_index = npos;
+};
+
+// 定时重新加载的只读数据: 新版本原子替换当前指针, 旧版本等所有可能读到它的读者离开后再释放(epoch)
+// 读取不加锁不分配内存, 只写本线程的槽位
+template <typename STORE>
+class Snapshot
+{
+public:
+    // 持有期间读到的版本不会被释放, 不要跨越长时间的操作
+    class Guard
+    {
+    public:
+        Guard(Snapshot* snapshot, size_t index, const STORE* store)
+            : m_snapshot(snapshot)
+            , m_index(index)
+            , m_store(store)
+        {
+        }
+
+        Guard(Guard&& other) noexcept
+            : m_snapshot(std::exchange(other.m_snapshot, nullptr))
+            , m_index(other.m_index)
+            , m_store(other.m_store)
+        {
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+        ~Guard()
+        {
+            if (m_snapshot)
+            {
+                m_snapshot->Unpin(m_index);
+            }
+        }
+
+        const STORE* Get() const { return m_store; }
+
+        const STORE* operator->() const { return m_store; }
+
+        const STORE& operator*() const { return *m_store; }
+
+        // 第一次加载完成前为空
+        explicit operator bool() const { return m_store != nullptr; }
+
+    private:
+        Snapshot* m_snapshot;
+        size_t m_index;
+        const STORE* m_store;
+    };
+
+    Snapshot() = default;
+
+    ~Snapshot() { Stop(); }
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    Guard Read()
+    {
+        size_t index = ReaderId::Get();
+        if (index == ReaderId::npos)
+        {
+            m_overflow.fetch_add(1);
+        }
+        else
+        {
+            Slot& slot = m_slot_vect[index];
+            if (slot.m_depth++ == 0)
+            {
+                slot.m_epoch.store(m_epoch.load());
+            }
+        }
+        return Guard(this, index, m_current.load());
+    }
+
+    // 发布新版本, 旧版本进入待释放列表
+    void Publish(std::shared_ptr<STORE> store)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_current.exchange(store.get());
+        m_retire_list.emplace_back(m_epoch.fetch_add(1), std::move(m_owner));
+        m_owner = std::move(store);
+        m_version++;
+        Reclaim();
+    }
+
+    // 定时执行 query, 每次的结果发布为新版本; 上一次加载结束后才开始计时
+    template <typename POOL>
+    void Start(Query query, POOL& pool, const DBConfig& config, int64_t interval_ms, int32_t parallel = 1)
+    {
+        Stop();
+        m_stop = false;
+        m_thread = std::thread([this, query = std::move(query), &pool, config, interval_ms, parallel]() mutable {
+            while (!m_stop)
+            {
+                Reload(query, pool, config, parallel);
+                auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval_ms);
+                std::unique_lock<std::mutex> lk(m_mut);
+                while (!m_stop && std::chrono::steady_clock::now() < next)
+                {
+                    // 还有没释放的旧版本时隔一小段时间再检查一次
+                    auto wake = m_retire_list.empty() ? next : std::min(next, std::chrono::steady_clock::now() + std::chrono::milliseconds(m_reclaim_ms));
+                    m_cond.wait_until(lk, wake);
+                    Reclaim();
+                }
+            }
+        });
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_stop = true;
+            if (m_reload_queue)
+            {
+                m_reload_queue->SetEmpty();
+            }
+        }
+        m_cond.notify_all();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    // 已经发布的版本数
+    uint64_t Version()
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        return m_version;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> m_epoch{0};  // 0 表示没有在读
+        size_t m_depth = 0;                // 只有所属线程访问, 支持嵌套读取
+    };
+
+    void Unpin(size_t index)
+    {
+        if (index == ReaderId::npos)
+        {
+            m_overflow.fetch_sub(1);
+            return;
+        }
+
+        Slot& slot = m_slot_vect[index];
+        if (--slot.m_depth == 0)
+        {
+            slot.m_epoch.store(0);
+        }
+    }
+
+    // 在 epoch 之前退役的版本, 只有 epoch 不大于它的读者可能还在使用; 需要持有 m_mut
+    void Reclaim()
+    {
+        if (m_retire_list.empty() || m_overflow.load() > 0)
+        {
+            return;
+        }
+
+        uint64_t min_epoch = UINT64_MAX;
+        for (auto& slot : m_slot_vect)
+        {
+            uint64_t epoch = slot.m_epoch.load();
+            if (epoch != 0 && epoch < min_epoch)
+            {
+                min_epoch = epoch;
+            }
+        }
+
+        while (!m_retire_list.empty() && m_retire_list.front().first < min_epoch)
+        {
+            m_retire_list.pop_front();
+        }
+    }
+
+    // 查询结果通过单独的队列返回, 停止时唤醒等待, 晚到的结果不再访问 this
+    template <typename POOL>
+    void Reload(Query& query, POOL& pool, const DBConfig& config, int32_t parallel)
+    {
+        auto queue = std::make_shared<DataQueue<std::shared_ptr<STORE>>>();
+        queue->SetMax(1);
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            if (m_stop)
+            {
+                return;
+            }
+            m_reload_queue = queue;
+        }
+
+        query.Submit<STORE>(parallel, pool, config, nullptr, [queue](std::shared_ptr<STORE> data) { queue->Push(data); });
+        std::shared_ptr<STORE> data;
+        bool ret = queue->Pop(data);
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_reload_queue = nullptr;
+        }
+
+        if (ret && data)
+        {
+            Publish(std::move(data));
+        }
+    }
+
+    static constexpr int64_t m_reclaim_ms = 10;
+    Slot m_slot_vect[ReaderId::m_max];
+    std::atomic<size_t> m_overflow{0};
+    std::atomic<uint64_t> m_epoch{1};
+    std::atomic<const STORE*> m_current{nullptr};
+
+    std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::shared_ptr<const STORE> m_owner;
+    std::deque<std::pair<uint64_t, std::shared_ptr<const STORE>>> m_retire_list;
+    uint64_t m_version = 0;
+    std::atomic<bool> m_stop{true};
+    std::shared_ptr<DataQueue<std::shared_ptr<STORE>>> m_reload_queue;
+    std::thread m_thread;
+};
+
+#endif  // _DB_SNAPSHOT_H
@@ -0,0 +1,285 @@
+#ifndef _DB_STATEMENT_H
+#define _DB_STATEMENT_H
+
+#include <mysql/mysql.h>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+template <typename T>
+struct StmtType
+{
+    static const bool m_direct = false;
+};
+
+#define DB_STMT_TYPE(TYPE, FIELD_TYPE, IS_UNSIGNED)                  \
+    template <>                                                      \
+    struct StmtType<TYPE>                                            \
+    {                                                                \
+        static const bool m_direct = true;                           \
+        static const enum_field_types m_type = FIELD_TYPE;           \
+        static const bool m_unsigned = IS_UNSIGNED;                  \
+    };
+
+DB_STMT_TYPE(int8_t, MYSQL_TYPE_TINY, false)
+DB_STMT_TYPE(uint8_t, MYSQL_TYPE_TINY, true)
+DB_STMT_TYPE(int16_t, MYSQL_TYPE_SHORT, false)
+DB_STMT_TYPE(uint16_t, MYSQL_TYPE_SHORT, true)
+DB_STMT_TYPE(int32_t, MYSQL_TYPE_LONG, false)
+DB_STMT_TYPE(uint32_t, MYSQL_TYPE_LONG, true)
+DB_STMT_TYPE(int64_t, MYSQL_TYPE_LONGLONG, false)
+DB_STMT_TYPE(uint64_t, MYSQL_TYPE_LONGLONG, true)
+DB_STMT_TYPE(float, MYSQL_TYPE_FLOAT, false)
+DB_STMT_TYPE(double, MYSQL_TYPE_DOUBLE, false)
+
+#undef DB_STMT_TYPE
+
+struct StmtBind
+{
+    // 输入参数直接指向参数对象, execute 前不能失效
+    static void Param(MYSQL_BIND& bind, const std::string& data)
+    {
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = const_cast<char*>(data.data());
+        bind.buffer_length = data.size();
+    }
+
+    template <typename T>
+    static void Param(MYSQL_BIND& bind, const T& data)
+    {
+        static_assert(StmtType<T>::m_direct, "unsupported statement param type");
+        bind.buffer_type = StmtType<T>::m_type;
+        bind.buffer = const_cast<T*>(&data);
+        bind.is_unsigned = StmtType<T>::m_unsigned;
+    }
+};
+
+// mysql_stmt_* 的封装, 一个连接上 prepare 一次, 多次 execute; 由 StatementCache 按连接保存
+class Statement
+{
+public:
+    explicit Statement(MYSQL* con)
+        : m_stmt(mysql_stmt_init(con))
+    {
+    }
+
+    ~Statement()
+    {
+        if (m_stmt)
+        {
+            mysql_stmt_close(m_stmt);
+        }
+    }
+
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    bool Prepare(const std::string& sql)
+    {
+        if (!m_stmt || mysql_stmt_prepare(m_stmt, sql.c_str(), sql.size()) != 0)
+        {
+            return false;
+        }
+
+        m_field_vect.clear();
+        MYSQL_RES* meta = mysql_stmt_result_metadata(m_stmt);
+        if (meta)
+        {
+            MYSQL_FIELD* field;
+            while ((field = mysql_fetch_field(meta)))
+            {
+                m_field_vect.emplace_back(field->name);
+            }
+            mysql_free_result(meta);
+        }
+
+        m_result_vect.assign(m_field_vect.size(), MYSQL_BIND());
+        m_column_vect.assign(m_field_vect.size(), Column());
+        for (size_t i = 0; i < m_result_vect.size(); i++)
+        {
+            m_result_vect[i].length = &m_column_vect[i].m_length;
+            m_result_vect[i].is_null = &m_column_vect[i].m_is_null;
+            m_result_vect[i].error = &m_column_vect[i].m_error;
+        }
+        return true;
+    }
+
+    const std::vector<std::string>& Field() const { return m_field_vect; }
+
+    // 结果直接写入成员变量
+    template <typename T>
+    void BindData(size_t i, T& data)
+    {
+        m_result_vect[i].buffer_type = StmtType<T>::m_type;
+        m_result_vect[i].buffer = &data;
+        m_result_vect[i].buffer_length = sizeof(T);
+        m_result_vect[i].is_unsigned = StmtType<T>::m_unsigned;
+        m_column_vect[i].m_scratch = false;
+    }
+
+    // 结果以字符串形式写入内部缓冲区
+    void BindBuffer(size_t i, size_t size = 64)
+    {
+        auto& column = m_column_vect[i];
+        column.m_scratch = true;
+        column.m_buffer.resize(size);
+        m_result_vect[i].buffer_type = MYSQL_TYPE_STRING;
+        m_result_vect[i].buffer = &column.m_buffer[0];
+        m_result_vect[i].buffer_length = size - 1;
+    }
+
+    bool BindResult() { return m_result_vect.empty() || !mysql_stmt_bind_result(m_stmt, m_result_vect.data()); }
+
+    // store 为 false 时不在客户端缓存结果集, Fetch 逐行从服务端读取, 读完或 FreeResult 之前连接不能执行其他语句
+    bool Execute(std::vector<MYSQL_BIND>& param_vect, bool store = true)
+    {
+        if (!param_vect.empty() && mysql_stmt_bind_param(m_stmt, param_vect.data()))
+        {
+            return false;
+        }
+        return mysql_stmt_execute(m_stmt) == 0 && (!store || mysql_stmt_store_result(m_stmt) == 0);
+    }
+
+    // 1: 取到一行, 0: 没有数据, -1: 出错
+    int32_t Fetch()
+    {
+        int32_t ret = mysql_stmt_fetch(m_stmt);
+        if (ret == MYSQL_NO_DATA)
+        {
+            return 0;
+        }
+
+        if (ret == MYSQL_DATA_TRUNCATED)
+        {
+            return Refetch() ? 1 : -1;
+        }
+        return ret == 0 ? 1 : -1;
+    }
+
+    void FreeResult() { mysql_stmt_free_result(m_stmt); }
+
+    const char* Data(size_t i, size_t& len)
+    {
+        auto& column = m_column_vect[i];
+        if (column.m_is_null)
+        {
+            len = 0;
+            return nullptr;
+        }
+        len = column.m_length;
+        column.m_buffer[len] = '\0';
+        return column.m_buffer.data();
+    }
+
+    const char* Error() const { return m_stmt ? mysql_stmt_error(m_stmt) : "mysql_stmt_init failed"; }
+
+private:
+    struct Column
+    {
+        unsigned long m_length = 0;
+        std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type m_is_null = 0;
+        std::remove_pointer<decltype(MYSQL_BIND::error)>::type m_error = 0;
+        bool m_scratch = false;
+        std::vector<char> m_buffer;
+    };
+
+    // 字符串列被截断时扩容后重新取该列
+    bool Refetch()
+    {
+        bool rebind = false;
+        for (size_t i = 0; i < m_column_vect.size(); i++)
+        {
+            auto& column = m_column_vect[i];
+            if (!column.m_scratch || !column.m_error)
+            {
+                continue;
+            }
+
+            BindBuffer(i, column.m_length + 1);
+            if (mysql_stmt_fetch_column(m_stmt, &m_result_vect[i], i, 0) != 0)
+            {
+                return false;
+            }
+            rebind = true;
+        }
+        return !rebind || BindResult();
+    }
+
+    MYSQL_STMT* m_stmt = nullptr;
+    std::vector<std::string> m_field_vect;
+    std::vector<MYSQL_BIND> m_result_vect;
+    std::vector<Column> m_column_vect;
+};
+
+// 每个连接上已经 prepare 的语句, key 为 sql; 连接同一时间只被一个请求使用, 语句只在持有连接的线程上访问
+class StatementCache
+{
+public:
+    static StatementCache& Instance()
+    {
+        static StatementCache cache;
+        return cache;
+    }
+
+    // 第一次使用时 prepare, 失败返回 nullptr 并设置 error
+    Statement* Get(MYSQL* con, const std::string& sql, std::string& error)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            auto& stmt_table = m_con_table[con];
+            auto iter = stmt_table.find(sql);
+            if (iter != stmt_table.end())
+            {
+                return iter->second.get();
+            }
+        }
+
+        auto stmt = std::unique_ptr<Statement>(new Statement(con));
+        if (!stmt->Prepare(sql))
+        {
+            error = stmt->Error();
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lk(m_mut);
+        auto& stmt_table = m_con_table[con];
+        if (stmt_table.size() >= m_max_stmt)
+        {
+            stmt_table.clear();
+        }
+        auto& slot = stmt_table[sql];
+        slot = std::move(stmt);
+        return slot.get();
+    }
+
+    // 执行出错(如自动重连后服务端的语句已经失效)时丢弃, 下次重新 prepare
+    void Erase(MYSQL* con, const std::string& sql)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        auto iter = m_con_table.find(con);
+        if (iter != m_con_table.end())
+        {
+            iter->second.erase(sql);
+        }
+    }
+
+    // 在 mysql_close 之前调用
+    void Close(MYSQL* con)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_con_table.erase(con);
+    }
+
+private:
+    // 每个连接最多保留的语句数, 超出时全部关闭
+    static constexpr size_t m_max_stmt = 64;
+
+    std::mutex m_mut;
+    std::unordered_map<MYSQL*, std::unordered_map<std::string, std::unique_ptr<Statement>>> m_con_table;
+};
+
+#endif  // _DB_STATEMENT_H
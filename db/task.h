@@ -0,0 +1,434 @@
+#ifndef _DB_TASK_H
+#define _DB_TASK_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 协程恢复的位置, 流水线的解码任务也提交到执行器
+struct Executor
+{
+    virtual ~Executor() = default;
+    virtual void Post(std::function<void()> func) = 0;
+    // 挂起前调用, 表示之后会有一次 Post
+    virtual void Expect() {}
+};
+
+// 固定线程数的执行器
+class ThreadExecutor : public Executor
+{
+public:
+    explicit ThreadExecutor(int32_t thread_num = 1)
+    {
+        for (int32_t i = 0; i < std::max(thread_num, 1); i++)
+        {
+            m_thread_vect.emplace_back(&ThreadExecutor::Thread, this);
+        }
+    }
+
+    ~ThreadExecutor() override
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (auto& thread : m_thread_vect)
+        {
+            thread.join();
+        }
+    }
+
+    ThreadExecutor(const ThreadExecutor&) = delete;
+    ThreadExecutor& operator=(const ThreadExecutor&) = delete;
+
+    // 在锁内通知, 协程恢复后可以立即析构执行器
+    void Post(std::function<void()> func) override
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_func_queue.emplace_back(std::move(func));
+        m_cond.notify_one();
+    }
+
+private:
+    void Thread()
+    {
+        while (true)
+        {
+            std::function<void()> func;
+            {
+                std::unique_lock<std::mutex> lk(m_mut);
+                m_cond.wait(lk, [this]() { return m_stop || !m_func_queue.empty(); });
+                if (m_func_queue.empty())
+                {
+                    return;
+                }
+                func = std::move(m_func_queue.front());
+                m_func_queue.pop_front();
+            }
+            func();
+        }
+    }
+
+    std::mutex m_mut;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_func_queue;
+    bool m_stop = false;
+    std::vector<std::thread> m_thread_vect;
+};
+
+// 协程接口, 需要 C++20
+#if defined(__cpp_impl_coroutine)
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include "event.h"
+
+// 在 event_base 的线程上恢复协程, 所有查询共用一个 eventfd; 没有等待中的查询时不占用 event_base
+class EventExecutor : public Executor
+{
+public:
+    explicit EventExecutor(event_base* base)
+    {
+        m_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        assert(m_fd != -1);
+        m_event = event_new(base, m_fd, EV_READ | EV_PERSIST, &EventExecutor::Callback, this);
+    }
+
+    ~EventExecutor() override
+    {
+        event_free(m_event);
+        close(m_fd);
+    }
+
+    EventExecutor(const EventExecutor&) = delete;
+    EventExecutor& operator=(const EventExecutor&) = delete;
+
+    void Post(std::function<void()> func) override
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_func_vect.emplace_back(std::move(func));
+        }
+        int64_t data = 1;
+        write(m_fd, &data, sizeof(data));
+    }
+
+    // 只能在 event_base 的线程上调用
+    void Expect() override
+    {
+        if (m_expect++ == 0)
+        {
+            event_add(m_event, nullptr);
+        }
+    }
+
+private:
+    static void Callback(evutil_socket_t fd, short, void* ptr)
+    {
+        int64_t data;
+        read(fd, &data, sizeof(data));
+
+        auto* executor = static_cast<EventExecutor*>(ptr);
+        std::vector<std::function<void()>> func_vect;
+        {
+            std::lock_guard<std::mutex> lk(executor->m_mut);
+            func_vect.swap(executor->m_func_vect);
+        }
+
+        for (auto& func : func_vect)
+        {
+            func();
+        }
+
+        executor->m_expect -= std::min(executor->m_expect, func_vect.size());
+        if (executor->m_expect == 0)
+        {
+            event_del(executor->m_event);
+        }
+    }
+
+    int32_t m_fd = -1;
+    event* m_event = nullptr;
+    size_t m_expect = 0;
+    std::mutex m_mut;
+    std::vector<std::function<void()>> m_func_vect;
+};
+
+template <typename T>
+class Task;
+
+template <typename T>
+struct TaskPromiseBase
+{
+    // 结束时直接切换到等待者
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename PROMISE>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<PROMISE> handle) noexcept
+        {
+            auto next = handle.promise().m_next;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { m_error = std::current_exception(); }
+
+    std::coroutine_handle<> m_next;
+    std::exception_ptr m_error;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T>
+{
+    Task<T> get_return_object();
+
+    template <typename V>
+    void return_value(V&& value)
+    {
+        m_value.emplace(std::forward<V>(value));
+    }
+
+    T Result()
+    {
+        if (this->m_error)
+        {
+            std::rethrow_exception(this->m_error);
+        }
+        return std::move(*m_value);
+    }
+
+    std::optional<T> m_value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void>
+{
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void Result()
+    {
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+};
+
+// 惰性协程, 被 co_await 时才开始执行
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = TaskPromise<T>;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+
+    explicit Task(handle_t handle)
+        : m_handle(handle)
+    {
+    }
+
+    Task(Task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {
+    }
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const { return !m_handle || m_handle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> next)
+    {
+        m_handle.promise().m_next = next;
+        return m_handle;
+    }
+
+    T await_resume() { return m_handle.promise().Result(); }
+
+private:
+    handle_t m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// 立即执行, 结束后自行释放
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// 在当前线程启动一个协程, 不等待结果
+template <typename T>
+DetachedTask Spawn(Task<T> task)
+{
+    co_await task;
+}
+
+// 把任意 awaitable 包装成 Task, awaitable 按值保存在协程帧中
+template <typename AWAITABLE, typename T = decltype(std::declval<AWAITABLE&>().await_resume())>
+Task<T> MakeTask(AWAITABLE awaitable)
+{
+    co_return co_await awaitable;
+}
+
+// WhenAll 的计数器, 初始值为任务数 + 1, 多出的 1 在全部任务启动后减掉
+struct WhenAllLatch
+{
+    explicit WhenAllLatch(size_t count)
+        : m_count(count + 1)
+    {
+    }
+
+    bool await_ready() const { return false; }
+
+    // 所有任务都已经完成时不挂起
+    bool await_suspend(std::coroutine_handle<> next)
+    {
+        m_next = next;
+        m_start();
+        return m_count.fetch_sub(1) > 1;
+    }
+
+    // 全部任务完成后抛出第一个任务的异常
+    void await_resume()
+    {
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+    void Fail(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if (!m_error)
+        {
+            m_error = std::move(error);
+        }
+    }
+
+    void Done()
+    {
+        if (m_count.fetch_sub(1) == 1)
+        {
+            m_next.resume();
+        }
+    }
+
+    std::atomic<size_t> m_count;
+    std::coroutine_handle<> m_next;
+    std::function<void()> m_start;
+    std::mutex m_mut;
+    std::exception_ptr m_error;
+};
+
+// 任务的异常交给 latch, 不能从 DetachedTask 中抛出
+template <typename T>
+DetachedTask WhenAllItem(Task<T>& task, T& result, WhenAllLatch& latch)
+{
+    try
+    {
+        result = co_await task;
+    }
+    catch (...)
+    {
+        latch.Fail(std::current_exception());
+    }
+    latch.Done();
+}
+
+// 同时启动所有任务, 全部完成后按顺序返回结果; 有任务抛出异常时等全部完成后抛出第一个异常
+template <typename T>
+Task<std::vector<T>> WhenAll(std::vector<Task<T>> task_vect)
+{
+    std::vector<T> res(task_vect.size());
+    WhenAllLatch latch(task_vect.size());
+    latch.m_start = [&]() {
+        for (size_t i = 0; i < task_vect.size(); i++)
+        {
+            WhenAllItem(task_vect[i], res[i], latch);
+        }
+    };
+    co_await latch;
+    co_return std::move(res);
+}
+
+template <typename... T>
+Task<std::tuple<T...>> WhenAll(Task<T>... task)
+{
+    std::tuple<T...> res;
+    auto task_tuple = std::forward_as_tuple(task...);
+    WhenAllLatch latch(sizeof...(T));
+    latch.m_start = [&]() {
+        std::apply([&](auto&... result) {
+            std::apply([&](auto&... item) { (WhenAllItem(item, result, latch), ...); }, task_tuple);
+        }, res);
+    };
+    co_await latch;
+    co_return std::move(res);
+}
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // _DB_TASK_H
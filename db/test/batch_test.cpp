@@ -0,0 +1,71 @@
+#include <sstream>
+#include "test.h"
+
+namespace
+{
+// in (...) 中的每个 id 返回一行
+std::shared_ptr<FakeDriver> MakeInDriver()
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->SetHandler([](const std::string& sql) {
+        size_t start = sql.find('(') + 1;
+        std::stringstream stream(sql.substr(start, sql.find(')') - start));
+        std::vector<std::string> cell_vect;
+        std::string id;
+        while (std::getline(stream, id, ','))
+        {
+            cell_vect.push_back(id);
+        }
+        std::vector<std::vector<const char*>> row_vect;
+        for (auto& cell : cell_vect)
+        {
+            row_vect.push_back({cell.c_str(), cell.c_str()});
+        }
+        return FakeDriver::Make({"id", "value"}, row_vect);
+    });
+    return driver;
+}
+}  // namespace
+
+TEST(BatchParam)
+{
+    auto driver = MakeInDriver();
+    DBPool pool(1, driver);
+    auto param_vect = std::make_shared<std::vector<TestParam>>();
+    for (int32_t i = 0; i < 100; i++)
+    {
+        param_vect->push_back(TestParam{i, ""});
+    }
+
+    Query query;
+    query.Init("select {} from data where id in ({batch})", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(param_vect, "id", &TestParam::id)
+        .Batch("{id}", 10)
+        .Store([](std::map<int32_t, TestRow>& data_table, TestRow* data, Row&) { data_table[data->id] = *data; });
+    auto data = RunQuery<std::map<int32_t, TestRow>>(query, pool, TestConfig("batch_param"));
+    CHECK(data && data->size() == 100);
+    CHECK(driver->QueryCount() == 10);
+}
+
+TEST(StoreBatch)
+{
+    DBPool pool(1, MakeInDriver());
+    auto param_vect = std::make_shared<std::vector<TestParam>>();
+    for (int32_t i = 0; i < 25; i++)
+    {
+        param_vect->push_back(TestParam{i, ""});
+    }
+
+    auto batch_size = std::make_shared<std::vector<size_t>>();
+    Query query;
+    query.Init("select {} from data where id in ({batch})", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(param_vect, "id", &TestParam::id)
+        .Batch("{id}", 25)
+        .StoreBatch(10, [batch_size](std::vector<TestRow>& data_vect, std::vector<TestRow>& batch) {
+            batch_size->push_back(batch.size());
+            data_vect.insert(data_vect.end(), batch.begin(), batch.end());
+        });
+    auto data = RunQuery<std::vector<TestRow>>(query, pool, TestConfig("store_batch"));
+    CHECK(data && data->size() == 25);
+    CHECK((*batch_size == std::vector<size_t>{10, 10, 5}));
+}
@@ -0,0 +1,41 @@
+#include "test.h"
+
+namespace
+{
+std::shared_ptr<std::vector<TestRow>> Load(DBPool& pool, const DBConfig& config, bool stream)
+{
+    Query query;
+    query.Init("select {} from data", &TestRow::c0, "c0").Cache(60 * 1000);
+    if (stream)
+    {
+        query.Stream();
+    }
+    query.Store([](std::vector<TestRow>& data_vect, TestRow* data, Row&) { data_vect.push_back(*data); });
+    return RunQuery<std::vector<TestRow>>(query, pool, config);
+}
+}  // namespace
+
+TEST(CacheHit)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from data", FakeDriver::Generate(10, 1));
+    DBPool pool(1, driver);
+    auto config = TestConfig("cache_hit");
+    auto first = Load(pool, config, false);
+    auto second = Load(pool, config, false);
+    CHECK(first && first->size() == 10);
+    CHECK(second && second->size() == 10);
+    CHECK(driver->QueryCount() == 1);
+}
+
+TEST(CacheSkipStream)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from data", FakeDriver::Generate(10, 1));
+    DBPool pool(1, driver);
+    auto config = TestConfig("cache_skip_stream");
+    Load(pool, config, true);
+    auto data = Load(pool, config, true);
+    CHECK(data && data->size() == 10);
+    CHECK(driver->QueryCount() == 2);
+}
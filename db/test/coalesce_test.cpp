@@ -0,0 +1,94 @@
+#include "test.h"
+
+namespace
+{
+using Table = std::vector<TestRow>;
+}  // namespace
+
+TEST(CoalesceRun)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from data", FakeDriver::Generate(5, 1));
+    driver->SetLatency(std::chrono::milliseconds(50));
+    DBPool pool(3, driver);
+
+    Query query;
+    query.Init("select {} from data", &TestRow::c0, "c0").Coalesce().Store([](Table& table, TestRow* data, Row&) { table.push_back(*data); });
+    std::vector<std::unique_ptr<DataQueue<std::shared_ptr<Table>>>> queue_vect;
+    for (int32_t i = 0; i < 3; i++)
+    {
+        queue_vect.emplace_back(new DataQueue<std::shared_ptr<Table>>());
+        query.Run(1, pool, TestConfig("coalesce_run"), *queue_vect.back());
+    }
+
+    std::shared_ptr<Table> first;
+    for (auto& data_queue : queue_vect)
+    {
+        std::shared_ptr<Table> data;
+        data_queue->Pop(data);
+        CHECK(data && data->size() == 5);
+        first = first ? first : data;
+        CHECK(data == first);
+    }
+    CHECK(driver->QueryCount() == 1);
+}
+
+TEST(CoalesceLeaderFail)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    auto result = FakeDriver::Generate(3, 1);
+    auto calls = std::make_shared<std::atomic<int32_t>>(0);
+    driver->SetHandler([result, calls](const std::string&) -> FakeDriver::result_t {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return (*calls)++ == 0 ? nullptr : result;
+    });
+    DBPool pool(3, driver);
+
+    std::vector<std::unique_ptr<DataQueue<std::shared_ptr<Table>>>> queue_vect;
+    for (int32_t i = 0; i < 3; i++)
+    {
+        // 每次新建的 Query 之间只合并 sql, 执行者失败时等待者重新执行
+        queue_vect.emplace_back(new DataQueue<std::shared_ptr<Table>>());
+        Query query;
+        query.Init("select {} from data", &TestRow::c0, "c0").Coalesce().Store([](Table& table, TestRow* data, Row&) { table.push_back(*data); });
+        query.Run(1, pool, TestConfig("coalesce_leader_fail"), *queue_vect.back());
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    std::vector<size_t> size_vect;
+    for (auto& data_queue : queue_vect)
+    {
+        std::shared_ptr<Table> data;
+        data_queue->Pop(data);
+        size_vect.push_back(data ? data->size() : 0);
+    }
+    CHECK((size_vect == std::vector<size_t>{0, 3, 3}));
+    CHECK(*calls == 2);
+}
+
+// 等待者不取连接, 连接池只为执行者建立一个连接
+TEST(CoalesceFollowerNoConnection)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from data", FakeDriver::Generate(4, 1));
+    driver->SetLatency(std::chrono::milliseconds(50));
+    DBPool pool(3, driver);
+
+    std::vector<std::unique_ptr<DataQueue<std::shared_ptr<Table>>>> queue_vect;
+    for (int32_t i = 0; i < 3; i++)
+    {
+        queue_vect.emplace_back(new DataQueue<std::shared_ptr<Table>>());
+        Query query;
+        query.Init("select {} from data", &TestRow::c0, "c0").Coalesce().Store([](Table& table, TestRow* data, Row&) { table.push_back(*data); });
+        query.Run(1, pool, TestConfig("coalesce_follower"), *queue_vect.back());
+    }
+
+    for (auto& data_queue : queue_vect)
+    {
+        std::shared_ptr<Table> data;
+        data_queue->Pop(data);
+        CHECK(data && data->size() == 4);
+    }
+    CHECK(driver->QueryCount() == 1);
+    CHECK(driver->ConnectCount() == 1);
+}
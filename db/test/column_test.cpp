@@ -0,0 +1,61 @@
+#include "test.h"
+
+namespace
+{
+struct Info
+{
+    int32_t group = 0;
+    int32_t value = 0;
+
+    void Clear() { *this = Info(); }
+};
+}  // namespace
+
+TEST(ColumnStoreScan)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    std::vector<std::string> cell_vect;
+    for (int32_t i = 0; i < 100; i++)
+    {
+        cell_vect.push_back(std::to_string(i % 4));
+        cell_vect.push_back(std::to_string(i));
+    }
+    std::vector<std::vector<const char*>> row_vect;
+    for (size_t i = 0; i < cell_vect.size(); i += 2)
+    {
+        row_vect.push_back({cell_vect[i].c_str(), cell_vect[i + 1].c_str()});
+    }
+    driver->Record("select grp,value from data", FakeDriver::Make({"grp", "value"}, row_vect));
+    DBPool pool(1, driver);
+
+    Query query;
+    query.Init("select {} from data", &Info::group, "grp", &Info::value, "value").StoreColumn<Info>();
+    auto data = RunQuery<ColumnStore<Info>>(query, pool, TestConfig("column_store_scan"));
+    CHECK(data && data->Size() == 100);
+    if (!data)
+    {
+        return;
+    }
+
+    CHECK(data->Get(&Info::value)[42] == 42);
+    CHECK(data->Sum(&Info::value) == 4950);
+    auto sel = data->Filter(&Info::value, [](int32_t value) { return value >= 90; });
+    CHECK(sel.size() == 10);
+    CHECK(data->Sum(&Info::value, &sel) == 945);
+    CHECK(data->Min(&Info::value, &sel) == 90 && data->Max(&Info::value, &sel) == 99);
+    auto group = data->GroupBy(&Info::group, &Info::value);
+    CHECK(group.size() == 4);
+    CHECK(group[1].m_count == 25 && group[1].m_sum == 1225);
+}
+
+// 列只能追加, 和 Delta 一起使用时不执行 sql
+TEST(ColumnStoreDelta)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    DBPool pool(1, driver);
+    Query query;
+    query.Init("select {} from data where value>{watermark}", &Info::group, "grp", &Info::value, "value").Delta("value").StoreColumn<Info>();
+    auto data = RunQuery<ColumnStore<Info>>(query, pool, TestConfig("column_store_delta"));
+    CHECK(!data);
+    CHECK(driver->QueryCount() == 0);
+}
@@ -0,0 +1,115 @@
+#include <future>
+#include "test.h"
+
+TEST(ConnectPoolReuse)
+{
+    FakeDriver driver;
+    auto config = std::make_shared<DBConfig>(TestConfig("connect_pool_reuse"));
+    ConnectPool connect_pool(config, &driver);
+    DBRequest req;
+    MYSQL* con = nullptr;
+    CHECK(connect_pool.Checkout(req, con));
+    CHECK(con);
+    CHECK(!connect_pool.Checkin(con, req));
+    MYSQL* reuse = nullptr;
+    CHECK(connect_pool.Checkout(req, reuse));
+    CHECK(reuse == con);
+    connect_pool.Checkin(con, req);
+    CHECK(driver.ConnectCount() == 1);
+}
+
+TEST(ConnectPoolWaitTimeout)
+{
+    FakeDriver driver;
+    auto config = std::make_shared<DBConfig>(TestConfig("connect_pool_wait_timeout"));
+    config->m_max_connect = 1;
+    config->m_wait_timeout = 20;
+    ConnectPool connect_pool(config, &driver);
+    DBRequest req;
+    MYSQL* con = nullptr;
+    CHECK(connect_pool.Checkout(req, con));
+    CHECK(con);
+
+    // 达到上限时排队, 归还的连接直接交给排队的请求
+    int32_t value = 0;
+    DBRequest wait(config, [&](MYSQL*) { value = 1; });
+    MYSQL* wait_con = nullptr;
+    CHECK(!connect_pool.Checkout(wait, wait_con));
+    CHECK(connect_pool.Expire().empty());
+    DBRequest next;
+    CHECK(connect_pool.Checkin(con, next));
+    CHECK(next.m_ready && next.m_con == con);
+    next.m_func(next.m_con);
+    CHECK(value == 1);
+
+    // 超时后交还, 连接为空
+    CHECK(!connect_pool.Checkout(wait, wait_con));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    auto req_vect = connect_pool.Expire();
+    CHECK(req_vect.size() == 1);
+    CHECK(req_vect[0].m_ready && !req_vect[0].m_con);
+    connect_pool.Checkin(con, next);
+}
+
+TEST(ConnectPoolMaintain)
+{
+    FakeDriver driver;
+    auto config = std::make_shared<DBConfig>(TestConfig("connect_pool_maintain"));
+    config->m_min_connect = 3;
+    ConnectPool connect_pool(config, &driver);
+    connect_pool.Maintain();
+    CHECK(driver.ConnectCount() == 3);
+
+    std::vector<MYSQL*> con_vect;
+    for (int32_t i = 0; i < 3; i++)
+    {
+        DBRequest req;
+        MYSQL* con = nullptr;
+        connect_pool.Checkout(req, con);
+        con_vect.push_back(con);
+    }
+    CHECK(driver.ConnectCount() == 3);
+    for (auto con : con_vect)
+    {
+        DBRequest next;
+        connect_pool.Checkin(con, next);
+    }
+}
+
+// 连接数达到上限时请求排队, 不占用工作线程
+TEST(DBPoolConnectLimit)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->SetLatency(std::chrono::microseconds(5000));
+    driver->Record("select 1", FakeDriver::Generate(1, 1));
+    auto config = TestConfig("db_pool_connect_limit");
+    config.m_max_connect = 1;
+    std::atomic<int32_t> ok{0};
+    {
+        DBPool pool(4, driver);
+        for (int32_t i = 0; i < 8; i++)
+        {
+            pool.Add([&](MYSQL* con, DBDriver* db_driver) {
+                if (con && db_driver->Query(con, "select 1") == 0)
+                {
+                    MYSQL_RES* res = db_driver->StoreResult(con);
+                    db_driver->FreeResult(res);
+                    ok++;
+                }
+            }, config);
+        }
+    }
+    CHECK(ok == 8);
+    CHECK(driver->ConnectCount() == 1);
+}
+
+TEST(DBPoolDriverAdd)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select 1", FakeDriver::Generate(1, 1));
+    DBPool pool(1, driver);
+    std::promise<int32_t> done;
+    pool.Add([&](MYSQL* con, DBDriver* db_driver) { done.set_value(con ? db_driver->Query(con, "select 1") : -1); },
+             TestConfig("db_pool_driver_add"));
+    CHECK(done.get_future().get() == 0);
+}
@@ -0,0 +1,82 @@
+#include <cmath>
+#include "db/convert.h"
+#include "db/row.h"
+#include "test.h"
+
+TEST(ConvertNumber)
+{
+    int32_t i32 = 1;
+    CHECK(Convert::ToData("-123", 4, i32) && i32 == -123);
+    // 只看 len, 不要求以 0 结尾
+    CHECK(Convert::ToData("4567", 2, i32) && i32 == 45);
+    CHECK(Convert::ToData("+8", 2, i32) && i32 == 8);
+    CHECK(!Convert::ToData("abc", 3, i32) && i32 == 0);
+    CHECK(!Convert::ToData("99999999999", 11, i32));
+
+    uint64_t u64 = 0;
+    CHECK(Convert::ToData("18446744073709551615", 20, u64) && u64 == UINT64_MAX);
+    double d = 0;
+    CHECK(Convert::ToData("2.5e3", 5, d) && d == 2500);
+    bool b = false;
+    CHECK(Convert::ToData("1", 1, b) && b);
+    CHECK(Convert::ToData("0", 1, b) && !b);
+}
+
+TEST(ConvertNull)
+{
+    int64_t i64 = 5;
+    CHECK(!Convert::ToData(nullptr, 0, i64) && i64 == 0);
+    std::string str = "x";
+    CHECK(!Convert::ToData(nullptr, 0, str) && str.empty());
+    CHECK(Convert::ToData("ab\0c", 4, str) && str == std::string("ab\0c", 4));
+
+    std::optional<int32_t> opt = 3;
+    CHECK(Convert::ToData(nullptr, 0, opt) && !opt);
+    CHECK(Convert::ToData("12", 2, opt) && opt && *opt == 12);
+}
+
+TEST(ConvertDecimal)
+{
+    Decimal<2> value;
+    CHECK(Convert::ToData("12.34", 5, value) && value.m_value == 1234);
+    CHECK(Convert::ToData("-0.5", 4, value) && value.m_value == -50);
+    CHECK(Convert::ToData("7", 1, value) && value.m_value == 700);
+    // 多余的小数位四舍五入
+    CHECK(Convert::ToData("1.005", 5, value) && value.m_value == 101);
+    CHECK(std::fabs(value.ToDouble() - 1.01) < 1e-9);
+    CHECK(!Convert::ToData(nullptr, 0, value) && value.m_value == 0);
+
+    // 超出 int64_t 时返回 false
+    CHECK(Convert::ToData("92233720368547758.07", 20, value) && value.m_value == INT64_MAX);
+    CHECK(!Convert::ToData("92233720368547758.08", 20, value) && value.m_value == 0);
+    CHECK(!Convert::ToData("92233720368547759", 17, value) && value.m_value == 0);
+    CHECK(!Convert::ToData("92233720368547758.075", 21, value));
+}
+
+TEST(RowGetNull)
+{
+    std::vector<std::string> field_vect{"id", "name"};
+    const char* cell[] = {nullptr, "x"};
+    unsigned long length[] = {0, 1};
+    Row row;
+    row.SetField(&field_vect);
+    row.SetRow(const_cast<char**>(cell), length);
+
+    // NULL 时写入默认值并返回 false, std::optional 可以区分 NULL
+    int32_t id = 5;
+    CHECK(!row.Get("id", id) && id == 0);
+    std::optional<int32_t> opt = 5;
+    CHECK(row.Get("id", opt) && !opt);
+    std::string name;
+    CHECK(row.Get("name", name) && name == "x");
+    CHECK(!row.Get("none", name));
+}
+
+TEST(ConvertDateTime)
+{
+    DateTime time;
+    CHECK(Convert::ToData("1970-01-02", 10, time) && time.m_second == 86400);
+    CHECK(Convert::ToData("2000-03-01 01:02:03.5", 21, time) && time.m_second == 951872523 && time.m_micro == 500000);
+    CHECK(Convert::ToData("0000-00-00 00:00:00", 19, time) && time.m_second == 0);
+    CHECK(!Convert::ToData("2000/01/01", 10, time));
+}
@@ -0,0 +1,118 @@
+#include <set>
+#include "test.h"
+
+namespace
+{
+struct Info
+{
+    int32_t id = 0;
+    std::string name;
+    int64_t ver = 0;
+
+    void Clear() { *this = Info(); }
+};
+
+using Table = std::map<int32_t, Info>;
+
+// 内存中的表, 按 ver>watermark 返回变化的行
+struct Source
+{
+    std::shared_ptr<FakeDriver> MakeDriver()
+    {
+        auto driver = std::make_shared<FakeDriver>();
+        driver->SetHandler([this](const std::string& sql) {
+            std::lock_guard<std::mutex> lk(m_mut);
+            m_sql_vect.push_back(sql);
+            int64_t watermark = SqlNumber(sql, "ver>");
+            std::vector<std::string> cell_vect;
+            for (auto& row : m_table)
+            {
+                if (row.second.second > watermark)
+                {
+                    cell_vect.push_back(std::to_string(row.first));
+                    cell_vect.push_back(row.second.first);
+                    cell_vect.push_back(std::to_string(row.second.second));
+                }
+            }
+            std::vector<std::vector<const char*>> row_vect;
+            for (size_t i = 0; i < cell_vect.size(); i += 3)
+            {
+                row_vect.push_back({cell_vect[i].c_str(), cell_vect[i + 1].c_str(), cell_vect[i + 2].c_str()});
+            }
+            return FakeDriver::Make({"id", "name", "ver"}, row_vect);
+        });
+        return driver;
+    }
+
+    void Update(int32_t id, const std::string& name)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        m_table[id] = {name, ++m_ver};
+    }
+
+    bool Same(const Table& table)
+    {
+        std::lock_guard<std::mutex> lk(m_mut);
+        if (table.size() != m_table.size())
+        {
+            return false;
+        }
+        for (auto& row : m_table)
+        {
+            auto iter = table.find(row.first);
+            if (iter == table.end() || iter->second.name != row.second.first || iter->second.ver != row.second.second)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::mutex m_mut;
+    std::map<int32_t, std::pair<std::string, int64_t>> m_table;
+    int64_t m_ver = 0;
+    std::vector<std::string> m_sql_vect;
+};
+}  // namespace
+
+TEST(DeltaRefresh)
+{
+    Source source;
+    for (int32_t i = 0; i < 100; i++)
+    {
+        source.Update(i, "n" + std::to_string(i));
+    }
+    DBPool pool(1, source.MakeDriver());
+    Query query;
+    query.Init("select {} from data where ver>{watermark}", &Info::id, "id", &Info::name, "name", &Info::ver, "ver")
+        .Delta("ver", "0")
+        .Store([](Table& table, Info* data, Row&) { table[data->id] = *data; });
+
+    // 调用方一直持有最新的结果, 两个 store 轮流更新
+    std::shared_ptr<Table> current;
+    std::set<const Table*> store_set;
+    for (int32_t round = 0; round < 6; round++)
+    {
+        source.Update(round * 7, "u" + std::to_string(round));
+        source.Update(100 + round, "new");
+        auto data = RunQuery<Table>(query, pool, TestConfig("delta_refresh"));
+        CHECK(data && source.Same(*data));
+        CHECK(!current || current != data);
+        store_set.insert(data.get());
+        current = data;
+    }
+    CHECK(store_set.size() <= 3);
+    CHECK(source.m_sql_vect.back() == "select id,name,ver from data where ver>110");
+}
+
+// 水位直接拼入 sql, 只接受数值和日期时间
+TEST(DeltaWatermarkLiteral)
+{
+    auto literal = [](const std::string& value) { return QueryDelta::IsLiteral(value.data(), value.size()); };
+    CHECK(literal("110"));
+    CHECK(literal("-1.5"));
+    CHECK(literal("2024-01-02 03:04:05.123"));
+    CHECK(!literal(""));
+    CHECK(!literal("0 or 1=1"));
+    CHECK(!literal("1' --"));
+}
@@ -0,0 +1,75 @@
+#include <future>
+#include <utility>
+#include "db/engine.h"
+#include "test.h"
+
+#if defined(MYSQL_WAIT_READ)
+
+namespace
+{
+// 没有服务端监听的端口, 连接立即失败; 测试桩的其他端口一直连接不上
+DBConfig RefusedConfig(const std::string& name)
+{
+    DBConfig config;
+    config.m_conf_name = name;
+    config.m_host = "127.0.0.1";
+    config.m_port = 1;
+    config.m_max_connect = 1;
+    return config;
+}
+
+EngineRequest MakeRequest(std::promise<bool>& done)
+{
+    EngineRequest req;
+    req.m_next = [sent = false](std::string& sql) mutable {
+        sql = "select 1";
+        return !std::exchange(sent, true);
+    };
+    req.m_done = [&done](bool failed) { done.set_value(failed); };
+    return req;
+}
+}  // namespace
+
+TEST(EngineConnectFail)
+{
+    DBEngine engine(1);
+    auto config = RefusedConfig("engine_connect_fail");
+    std::vector<std::promise<bool>> done_vect(3);
+    for (auto& done : done_vect)
+    {
+        engine.Add(MakeRequest(done), config);
+    }
+
+    // 排队等待同一个连接的请求也按失败结束
+    for (auto& done : done_vect)
+    {
+        auto future = done.get_future();
+        bool ready = future.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+        CHECK(ready && future.get());
+    }
+}
+
+// 析构时正在连接的和排队的请求都按失败结束
+TEST(EngineDrain)
+{
+    auto config = RefusedConfig("engine_drain");
+    config.m_port = 2;
+    std::vector<std::promise<bool>> done_vect(3);
+    {
+        DBEngine engine(1);
+        for (auto& done : done_vect)
+        {
+            engine.Add(MakeRequest(done), config);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    for (auto& done : done_vect)
+    {
+        auto future = done.get_future();
+        bool ready = future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        CHECK(ready && future.get());
+    }
+}
+
+#endif  // MYSQL_WAIT_READ
@@ -0,0 +1,14 @@
+#include <cstdio>
+#include "test.h"
+
+int main()
+{
+    for (auto& test : TestList())
+    {
+        int32_t failed = TestFailed();
+        test.m_func();
+        printf("%s %s\n", TestFailed() == failed ? "[ OK ]" : "[FAIL]", test.m_name);
+    }
+    printf("%zu tests, %d checks failed\n", TestList().size(), TestFailed());
+    return TestFailed() == 0 ? 0 : 1;
+}
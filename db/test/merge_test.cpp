@@ -0,0 +1,69 @@
+#include "test.h"
+
+namespace
+{
+struct Sum
+{
+    int64_t m_value = 0;
+};
+}  // namespace
+
+TEST(MergeMap)
+{
+    auto driver = MakeDriver();
+    DBPool pool(4, driver);
+    Query query;
+    query.Init("select {} from data where id={id}", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(MakeParam(0, 100), "id", &TestParam::id)
+        .Store([](std::map<int32_t, TestRow>& data_table, TestRow* data, Row&) { data_table[data->id] = *data; });
+    auto data = RunQuery<std::map<int32_t, TestRow>>(query, pool, TestConfig("merge_map"), 4);
+    CHECK(data && data->size() == 100);
+    CHECK(data && data->at(42).value == 420);
+    CHECK(driver->QueryCount() == 100);
+}
+
+TEST(MergeVector)
+{
+    DBPool pool(4, MakeDriver());
+    Query query;
+    query.Init("select {} from data where id={id}", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(MakeParam(0, 64), "id", &TestParam::id)
+        .Store([](std::vector<TestRow>& data_vect, TestRow* data, Row&) { data_vect.push_back(*data); });
+    auto data = RunQuery<std::vector<TestRow>>(query, pool, TestConfig("merge_vector"), 4);
+    CHECK(data && data->size() == 64);
+}
+
+TEST(MergeCustom)
+{
+    DBPool pool(4, MakeDriver());
+    Query query;
+    query.Init("select value from data where id={id}")
+        .WithParam(MakeParam(0, 10), "id", &TestParam::id)
+        .Store([](Sum& sum, Row& row) {
+            int64_t value = 0;
+            row.Get("value", value);
+            sum.m_value += value;
+        })
+        .Merge([](Sum& dst, Sum& src) { dst.m_value += src.m_value; });
+    auto data = RunQuery<Sum>(query, pool, TestConfig("merge_custom"), 4);
+    CHECK(data && data->m_value == 450);
+}
+
+// 并行查询的分片共享一个内存资源
+TEST(MergeMemory)
+{
+    DBPool pool(4, MakeDriver());
+    std::atomic<int32_t> resource_count{0};
+    Query query;
+    query.Init("select {} from data where id={id}", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(MakeParam(0, 100), "id", &TestParam::id)
+        .Memory([&resource_count]() {
+            resource_count++;
+            return std::make_shared<std::pmr::monotonic_buffer_resource>();
+        })
+        .Store([](std::pmr::map<int32_t, TestRow>& data_table, TestRow* data, Row&) { data_table[data->id] = *data; });
+    auto data = RunQuery<std::pmr::map<int32_t, TestRow>>(query, pool, TestConfig("merge_memory"), 4);
+    CHECK(data && data->size() == 100);
+    CHECK(data && data->at(42).value == 420);
+    CHECK(resource_count == 1);
+}
@@ -0,0 +1,64 @@
+#include <set>
+#include "test.h"
+
+TEST(PackRoundTrip)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->SetHandler([](const std::string& sql) -> FakeDriver::result_t {
+        int64_t id = SqlNumber(sql, "id=");
+        // 出错的 sql 后面的由 Query 重新发送
+        if (id == 5)
+        {
+            return nullptr;
+        }
+        std::string cell = std::to_string(id);
+        return FakeDriver::Make({"id"}, {{cell.c_str()}});
+    });
+    DBPool pool(1, driver);
+    auto param_vect = std::make_shared<std::vector<TestParam>>();
+    for (int32_t i = 0; i < 32; i++)
+    {
+        param_vect->push_back(TestParam{i, ""});
+    }
+
+    Query query;
+    query.Init("select {} from data where id={id}", &TestRow::id, "id")
+        .WithParam(param_vect, "id", &TestParam::id)
+        .Pack(8)
+        .Store([](std::set<int32_t>& id_set, TestRow* data, Row&) { id_set.insert(data->id); });
+    auto data = RunQuery<std::set<int32_t>>(query, pool, TestConfig("pack_round_trip"));
+    CHECK(data && data->size() == 31);
+    CHECK(data && data->count(5) == 0 && data->count(6) == 1);
+    // 4 个包, 出错的包剩下的 2 条再发送一次
+    CHECK(driver->QueryCount() == 5);
+}
+
+// 打包时字符串参数由驱动转义, 自定义渲染的查询不打包
+TEST(PackEscape)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    auto sql_vect = std::make_shared<std::vector<std::string>>();
+    driver->SetHandler([sql_vect](const std::string& sql) -> FakeDriver::result_t {
+        sql_vect->push_back(sql);
+        return FakeDriver::Make({"id"}, {{"1"}});
+    });
+    DBPool pool(1, driver);
+    auto name_vect = std::make_shared<std::vector<TestParam>>(std::vector<TestParam>{{0, "it's"}, {1, "a\\b"}});
+
+    Query query;
+    query.Init("select {} from data where name='{name}'", &TestRow::id, "id")
+        .WithParam(name_vect, "name", &TestParam::name)
+        .Pack(8)
+        .Store([](std::set<int32_t>& id_set, TestRow* data, Row&) { id_set.insert(data->id); });
+    CHECK(RunQuery<std::set<int32_t>>(query, pool, TestConfig("pack_escape")));
+    CHECK(driver->QueryCount() == 1);
+    CHECK((*sql_vect == std::vector<std::string>{"select id from data where name='it\\'s'", "select id from data where name='a\\\\b'"}));
+
+    Query custom;
+    custom.Init("select {} from data where name='{name}'", &TestRow::id, "id")
+        .With(name_vect, [](std::string& sql, const TestParam& param) { Replace::SetData(sql, "name", param.name); })
+        .Pack(8)
+        .Store([](std::set<int32_t>& id_set, TestRow* data, Row&) { id_set.insert(data->id); });
+    CHECK(RunQuery<std::set<int32_t>>(custom, pool, TestConfig("pack_escape")));
+    CHECK(driver->QueryCount() == 3);
+}
@@ -0,0 +1,50 @@
+#include <set>
+#include "test.h"
+
+TEST(PipelineDecode)
+{
+    auto driver = MakeDriver(10);
+    driver->SetLatency(std::chrono::microseconds(200));
+    DBPool pool(1, driver);
+    Query query;
+    query.Init("select {} from data where id={id}", &TestRow::id, "id", &TestRow::value, "value")
+        .WithParam(MakeParam(0, 50), "id", &TestParam::id)
+        .Pipeline(3)
+        .Store([](std::vector<TestRow>& data_vect, TestRow* data, Row&) { data_vect.push_back(*data); });
+    auto data = RunQuery<std::vector<TestRow>>(query, pool, TestConfig("pipeline_decode"));
+    CHECK(data && data->size() == 500);
+    // 同一个子查询的结果集按顺序解码
+    bool ordered = true;
+    for (size_t i = 0; data && i < data->size(); i++)
+    {
+        ordered = ordered && (*data)[i].id == static_cast<int32_t>(i);
+    }
+    CHECK(ordered);
+}
+
+TEST(PipelineCoalesce)
+{
+    auto driver = MakeDriver(10);
+    driver->SetLatency(std::chrono::microseconds(200));
+    DBPool pool(3, driver);
+    std::vector<std::unique_ptr<DataQueue<std::shared_ptr<std::set<int32_t>>>>> queue_vect;
+    for (int32_t i = 0; i < 3; i++)
+    {
+        queue_vect.emplace_back(new DataQueue<std::shared_ptr<std::set<int32_t>>>());
+        Query query;
+        query.Init("select {} from data where id={id}", &TestRow::id, "id")
+            .WithParam(MakeParam(0, 20), "id", &TestParam::id)
+            .Pipeline(4)
+            .Coalesce()
+            .Store([](std::set<int32_t>& id_set, TestRow* data, Row&) { id_set.insert(data->id); });
+        query.Run(1, pool, TestConfig("pipeline_coalesce"), *queue_vect.back());
+    }
+
+    for (auto& data_queue : queue_vect)
+    {
+        std::shared_ptr<std::set<int32_t>> data;
+        data_queue->Pop(data);
+        CHECK(data && data->size() == 200);
+    }
+    CHECK(driver->QueryCount() < 60);
+}
@@ -0,0 +1,93 @@
+#include "db/replace.h"
+#include "test.h"
+
+namespace
+{
+struct Param
+{
+    int32_t id;
+    std::string name;
+};
+
+// 按参数名写入, 其他参数原样保留
+std::string Render(const SqlTemplate& sql, const Param& param)
+{
+    std::string out;
+    sql.Render(out, [&](std::string& buf, size_t slot) {
+        if (sql.SlotName(slot) == "id")
+        {
+            Replace::Append(buf, param.id);
+            return true;
+        }
+        if (sql.SlotName(slot) == "name")
+        {
+            Replace::Append(buf, param.name);
+            return true;
+        }
+        return false;
+    });
+    return out;
+}
+}  // namespace
+
+TEST(TemplateRender)
+{
+    SqlTemplate sql;
+    sql.Parse("select * from data where id={id} and name='{name}' and flag={other} or id={id}");
+    CHECK(sql.SlotCount() == 3);
+    CHECK(sql.FindSlot("name") == 1 && sql.FindSlot("batch") < 0);
+    CHECK(Render(sql, Param{-42, "abc"}) == "select * from data where id=-42 and name='abc' and flag={other} or id=-42");
+    // 复用的缓冲区每次重新渲染
+    CHECK(Render(sql, Param{7, ""}) == "select * from data where id=7 and name='' and flag={other} or id=7");
+
+    SqlTemplate nested;
+    nested.Parse("select {{id} from {");
+    CHECK(Render(nested, Param{1, ""}) == "select {1 from {");
+}
+
+TEST(ReplaceAppend)
+{
+    std::string out;
+    Replace::Append(out, static_cast<int64_t>(INT64_MIN));
+    out.push_back(' ');
+    Replace::Append(out, static_cast<uint64_t>(UINT64_MAX));
+    out.push_back(' ');
+    Replace::Append(out, true);
+    out.push_back(' ');
+    Replace::Append(out, 0.5);
+    CHECK(out == "-9223372036854775808 18446744073709551615 1 0.5");
+
+    std::string sql = "select {} from data where a={a} and b={a}";
+    Replace::SetData(sql, "a", 3);
+    Replace::SetData(sql, "id,name");
+    CHECK(sql == "select id,name from data where a=3 and b=3");
+}
+
+TEST(TemplatePrepare)
+{
+    SqlTemplate sql;
+    sql.Parse("select * from data where id={id} and name='{name}' and id<>{id}");
+    std::string out;
+    std::vector<size_t> slot_vect;
+    CHECK(sql.Prepare(out, slot_vect));
+    // 整个字符串字面量都是参数时去掉引号
+    CHECK(out == "select * from data where id=? and name=? and id<>?");
+    CHECK((slot_vect == std::vector<size_t>{0, 1, 0}));
+}
+
+TEST(TemplatePrepareLiteral)
+{
+    // 参数只是字面量的一部分时退回文本查询
+    SqlTemplate sql;
+    sql.Parse("select * from data where name like '%{name}%'");
+    std::string out;
+    std::vector<size_t> slot_vect;
+    CHECK(!sql.Prepare(out, slot_vect));
+
+    // 字面量中的引号不影响后面的参数
+    sql.Parse("select * from data where note='it''s {x}' and id={id} and name=\"{name}\"");
+    CHECK(!sql.Prepare(out, slot_vect));
+    sql.Parse("select * from data where note='it''s' and id={id} and name=\"{name}\"");
+    CHECK(sql.Prepare(out, slot_vect));
+    CHECK(out == "select * from data where note='it''s' and id=? and name=?");
+}
@@ -0,0 +1,61 @@
+#include <memory>
+#include <thread>
+#include "db/ring_queue.h"
+#include "test.h"
+
+TEST(RingQueueOrder)
+{
+    RingQueue<int32_t> queue(4);
+    queue.SetMax(3);
+    queue.Append(1);
+    queue.Push(2);
+    queue.PushBatch({3, 4});
+    CHECK(queue.Size() == 4);
+
+    std::vector<int32_t> data_vect;
+    CHECK(queue.PopBatch(data_vect, 3) == 3);
+    CHECK((data_vect == std::vector<int32_t>{1, 2, 3}));
+    int32_t data = 0;
+    CHECK(queue.Pop(data) && data == 4);
+    // 所有结果都已经取走, 不再等待
+    CHECK(queue.IsEmpty() && !queue.Pop(data));
+}
+
+TEST(RingQueueThreads)
+{
+    constexpr int32_t producer = 4;
+    constexpr int32_t count = 10000;
+    // 容量远小于数据量, 生产者需要等待消费者
+    RingQueue<std::shared_ptr<int32_t>> queue(16);
+    queue.SetMax(producer * count);
+    std::vector<std::thread> thread_vect;
+    for (int32_t i = 0; i < producer; i++)
+    {
+        thread_vect.emplace_back([&queue, i]() {
+            for (int32_t k = 0; k < count; k++)
+            {
+                queue.Push(std::make_shared<int32_t>(i * count + k));
+            }
+        });
+    }
+
+    int64_t sum = 0;
+    int64_t popped = 0;
+    std::vector<std::shared_ptr<int32_t>> data_vect;
+    while (queue.PopBatch(data_vect, 64) > 0)
+    {
+        for (auto& data : data_vect)
+        {
+            sum += *data;
+            popped++;
+        }
+    }
+    for (auto& thread : thread_vect)
+    {
+        thread.join();
+    }
+
+    int64_t total = producer * count;
+    CHECK(popped == total);
+    CHECK(sum == total * (total - 1) / 2);
+}
@@ -0,0 +1,48 @@
+#include "test.h"
+
+namespace
+{
+struct Info
+{
+    std::string name;
+    int32_t value = 0;
+
+    void Clear() { *this = Info(); }
+};
+
+std::shared_ptr<FakeDriver> MakeNameDriver()
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select name,value from data", FakeDriver::Make({"name", "value"}, {{"a", "1"}, {"b", "2"}, {nullptr, "3"}}));
+    return driver;
+}
+}  // namespace
+
+TEST(SchemaDecode)
+{
+    auto driver = MakeNameDriver();
+    DBPool pool(1, driver);
+    Schema schema(Field<&Info::name>("name"), Field<&Info::value>("value"));
+    Query query;
+    query.Init("select {} from data", schema).Store(schema, [](std::map<int32_t, Info>& data_table, Info* data, Row&) {
+        data_table[data->value] = *data;
+    });
+    auto data = RunQuery<std::map<int32_t, Info>>(query, pool, TestConfig("schema_decode"));
+    CHECK(data && data->size() == 3);
+    CHECK(data && data->at(2).name == "b" && data->at(3).name.empty());
+}
+
+TEST(SchemaMismatch)
+{
+    auto driver = MakeNameDriver();
+    DBPool pool(1, driver);
+    Schema schema(Field<&Info::name>("name"), Field<&Info::value>("value"));
+    Schema other(Field<&Info::value>("value"));
+    Query query;
+    query.Init("select {} from data", other).Store(schema, [](std::map<int32_t, Info>& data_table, Info* data, Row&) {
+        data_table[data->value] = *data;
+    });
+    auto data = RunQuery<std::map<int32_t, Info>>(query, pool, TestConfig("schema_mismatch"));
+    CHECK(!data);
+    CHECK(driver->QueryCount() == 0);
+}
@@ -0,0 +1,33 @@
+#include "db/snapshot.h"
+#include "test.h"
+
+TEST(SnapshotReload)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from data", FakeDriver::Generate(10, 1));
+    DBPool pool(1, driver);
+    Query query;
+    query.Init("select {} from data", &TestRow::c0, "c0").Store([](std::vector<TestRow>& data_vect, TestRow* data, Row&) {
+        data_vect.push_back(*data);
+    });
+
+    Snapshot<std::vector<TestRow>> snapshot;
+    CHECK(!snapshot.Read());
+    snapshot.Start(query, pool, TestConfig("snapshot_reload"), 5);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (snapshot.Version() < 3 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(snapshot.Version() >= 3);
+    {
+        auto guard = snapshot.Read();
+        CHECK(guard && guard->size() == 10);
+    }
+    snapshot.Stop();
+
+    auto store = std::make_shared<std::vector<TestRow>>(3);
+    snapshot.Publish(store);
+    auto guard = snapshot.Read();
+    CHECK(guard && guard->size() == 3);
+}
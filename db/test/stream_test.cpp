@@ -0,0 +1,30 @@
+#include "test.h"
+
+TEST(StreamChunk)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0,c1 from data", FakeDriver::Generate(1000, 2));
+    DBPool pool(1, driver);
+    Query query;
+    query.Init("select {} from data", &TestRow::c0, "c0", &TestRow::c1, "c1")
+        .Stream(300)
+        .Store([](std::vector<TestRow>& data_vect, TestRow* data, Row&) { data_vect.push_back(*data); });
+
+    DataQueue<std::shared_ptr<std::vector<TestRow>>> data_queue;
+    query.Run(1, pool, TestConfig("stream_chunk"), data_queue);
+    std::vector<size_t> chunk_vect;
+    int64_t last = -1;
+    bool ordered = true;
+    std::shared_ptr<std::vector<TestRow>> data;
+    while (data_queue.Pop(data))
+    {
+        chunk_vect.push_back(data ? data->size() : 0);
+        for (auto& info : data ? *data : std::vector<TestRow>())
+        {
+            ordered = ordered && info.c0 == last + 1;
+            last = info.c0;
+        }
+    }
+    CHECK((chunk_vect == std::vector<size_t>{300, 300, 300, 100}));
+    CHECK(ordered && last == 999);
+}
@@ -0,0 +1,65 @@
+#include <future>
+#include "test.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <stdexcept>
+
+namespace
+{
+using Table = std::vector<TestRow>;
+
+Task<std::shared_ptr<Table>> Load(DBPool& pool, const DBConfig& config, Executor& executor, std::string sql)
+{
+    Query query;
+    query.Init(sql, &TestRow::c0, "c0").Store([](Table& table, TestRow* data, Row&) { table.push_back(*data); });
+    co_return co_await query.Async<Table>(1, pool, config, executor);
+}
+
+Task<std::shared_ptr<Table>> Fail(DBPool& pool, const DBConfig& config, Executor& executor)
+{
+    co_await Load(pool, config, executor, "select {} from small");
+    throw std::runtime_error("load failed");
+}
+
+Task<void> Handle(DBPool& pool, const DBConfig& config, Executor& executor, std::promise<std::vector<size_t>>& done)
+{
+    std::vector<size_t> size_vect;
+    auto [a, b] = co_await WhenAll(Load(pool, config, executor, "select {} from small"),
+                                   Load(pool, config, executor, "select {} from large"));
+    size_vect.push_back(a->size());
+    size_vect.push_back(b->size());
+
+    std::vector<Task<std::shared_ptr<Table>>> task_vect;
+    task_vect.push_back(Load(pool, config, executor, "select {} from large"));
+    task_vect.push_back(Fail(pool, config, executor));
+    try
+    {
+        co_await WhenAll(std::move(task_vect));
+    }
+    catch (const std::runtime_error&)
+    {
+        size_vect.push_back(0);
+    }
+    done.set_value(size_vect);
+}
+}  // namespace
+
+TEST(AsyncWhenAll)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->Record("select c0 from small", FakeDriver::Generate(3, 1));
+    driver->Record("select c0 from large", FakeDriver::Generate(30, 1));
+    DBPool pool(2, driver);
+    ThreadExecutor executor(2);
+    // 协程恢复后还要使用 config, 不能传临时对象
+    auto config = TestConfig("async_when_all");
+
+    std::promise<std::vector<size_t>> done;
+    auto future = done.get_future();
+    Spawn(Handle(pool, config, executor, done));
+    CHECK(future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK((future.get() == std::vector<size_t>{3, 30, 0}));
+}
+
+#endif  // __cpp_impl_coroutine
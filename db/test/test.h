@@ -0,0 +1,126 @@
+#ifndef _DB_TEST_TEST_H
+#define _DB_TEST_TEST_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "db/fake_driver.h"
+#include "db/query.h"
+
+// 最小的测试框架: TEST 注册用例, CHECK 失败时打印位置并继续执行
+struct TestCase
+{
+    const char* m_name;
+    void (*m_func)();
+};
+
+inline std::vector<TestCase>& TestList()
+{
+    static std::vector<TestCase> test_list;
+    return test_list;
+}
+
+inline int32_t& TestFailed()
+{
+    static int32_t failed = 0;
+    return failed;
+}
+
+#define TEST(name)                                                                            \
+    static void name();                                                                       \
+    static const bool name##_registered = (TestList().push_back(TestCase{#name, &name}), true); \
+    static void name()
+
+#define CHECK(expr)                                                               \
+    do                                                                            \
+    {                                                                             \
+        if (!(expr))                                                              \
+        {                                                                         \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr);       \
+            TestFailed()++;                                                       \
+        }                                                                         \
+    } while (0)
+
+// 结果缓存和合并按配置名区分, 每个用例使用自己的配置名
+inline DBConfig TestConfig(const std::string& name)
+{
+    DBConfig config;
+    config.m_conf_name = name;
+    return config;
+}
+
+// 用例共用的参数类型
+struct TestParam
+{
+    int32_t id = 0;
+    std::string name;
+};
+
+// 用例共用的结果类型: id/value 对应 MakeDriver 的结果, c0/c1 对应 FakeDriver::Generate 的结果
+struct TestRow
+{
+    int32_t id = 0;
+    int64_t value = 0;
+    int64_t c0 = 0;
+    int64_t c1 = 0;
+
+    void Clear() { *this = TestRow(); }
+};
+
+// id 从 first 开始的 count 个参数
+inline std::shared_ptr<std::vector<TestParam>> MakeParam(int32_t first, int32_t count)
+{
+    auto param_vect = std::make_shared<std::vector<TestParam>>();
+    for (int32_t i = 0; i < count; i++)
+    {
+        param_vect->push_back(TestParam{first + i, ""});
+    }
+    return param_vect;
+}
+
+// 从 sql 中取出 key= 之后的整数
+inline int64_t SqlNumber(const std::string& sql, const std::string& key)
+{
+    size_t pos = sql.find(key);
+    return pos == std::string::npos ? -1 : atoll(sql.c_str() + pos + key.size());
+}
+
+// sql 中 id= 之后为 n 时返回 rows 行 id, value: id 为 n * rows + i, value 为 id * 10; 没有 id= 的 sql 出错
+inline std::shared_ptr<FakeDriver> MakeDriver(int64_t rows = 1)
+{
+    auto driver = std::make_shared<FakeDriver>();
+    driver->SetHandler([rows](const std::string& sql) -> FakeDriver::result_t {
+        int64_t id = SqlNumber(sql, "id=");
+        if (id < 0)
+        {
+            return nullptr;
+        }
+        std::vector<std::string> cell_vect;
+        for (int64_t i = 0; i < rows; i++)
+        {
+            cell_vect.push_back(std::to_string(id * rows + i));
+            cell_vect.push_back(std::to_string((id * rows + i) * 10));
+        }
+        std::vector<std::vector<const char*>> row_vect;
+        for (size_t i = 0; i < cell_vect.size(); i += 2)
+        {
+            row_vect.push_back({cell_vect[i].c_str(), cell_vect[i + 1].c_str()});
+        }
+        return FakeDriver::Make({"id", "value"}, row_vect);
+    });
+    return driver;
+}
+
+// 同步执行一次查询; Run 会把队列设置为只收一个结果, 每次都用新的队列
+template <typename Ret, typename POOL>
+std::shared_ptr<Ret> RunQuery(Query& query, POOL& pool, const DBConfig& config, int32_t parallel = 1)
+{
+    DataQueue<std::shared_ptr<Ret>> data_queue;
+    query.Run(parallel, pool, config, data_queue);
+    std::shared_ptr<Ret> data;
+    data_queue.Pop(data);
+    return data;
+}
+
+#endif  // _DB_TEST_TEST_H
@@ -1,6 +1,11 @@
 #ifndef _DB_SRV_TRAITS_H
 #define _DB_SRV_TRAITS_H
 
+#include <iterator>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+
 template <typename T>
 struct GetValueType
 {
@@ -48,4 +53,78 @@ struct Lambda
     }
 };
 
+// 使用 pmr 分配器的 store 从指定的内存资源构造, 其他 store 默认构造
+template <typename STORE, bool = std::uses_allocator<STORE, std::pmr::polymorphic_allocator<char>>::value>
+struct PmrStore
+{
+    static STORE Make(std::pmr::memory_resource*) { return STORE(); }
+};
+
+template <typename STORE>
+struct PmrStore<STORE, true>
+{
+    static STORE Make(std::pmr::memory_resource* resource)
+    {
+        return STORE(typename STORE::allocator_type(resource ? resource : std::pmr::get_default_resource()));
+    }
+};
+
+// 分配器不同的容器不能 swap/merge, 只能逐个移动元素
+template <typename STORE, typename = void>
+struct SameAllocator
+{
+    static bool Check(const STORE&, const STORE&) { return true; }
+};
+
+template <typename STORE>
+struct SameAllocator<STORE, std::void_t<decltype(std::declval<const STORE&>().get_allocator())>>
+{
+    static bool Check(const STORE& dst, const STORE& src) { return dst.get_allocator() == src.get_allocator(); }
+};
+
+// 并行查询的分片合并: 关联容器使用 merge(重复的 key 只保留一个), 序列容器追加到末尾
+template <typename STORE, typename = void>
+struct MergeStore
+{
+    static const bool value = false;
+};
+
+template <typename STORE>
+struct MergeStore<STORE, std::void_t<typename STORE::key_type, decltype(std::declval<STORE&>().merge(std::declval<STORE&>()))>>
+{
+    static const bool value = true;
+
+    static void Merge(STORE& dst, STORE& src)
+    {
+        if (!SameAllocator<STORE>::Check(dst, src))
+        {
+            dst.insert(std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+            src.clear();
+            return;
+        }
+
+        if (dst.size() < src.size())
+        {
+            dst.swap(src);
+        }
+        dst.merge(src);
+    }
+};
+
+template <typename STORE>
+struct MergeStore<STORE, std::void_t<decltype(std::declval<STORE&>().push_back(std::declval<typename STORE::value_type>()))>>
+{
+    static const bool value = true;
+
+    static void Merge(STORE& dst, STORE& src)
+    {
+        if (dst.size() < src.size() && SameAllocator<STORE>::Check(dst, src))
+        {
+            dst.swap(src);
+        }
+        dst.insert(dst.end(), std::make_move_iterator(src.begin()), std::make_move_iterator(src.end()));
+        src.clear();
+    }
+};
+
 #endif  // SEARCH_SRV_TRAITS_H